@@ -0,0 +1,161 @@
+// Runtime for the IntegrityCheck pass.
+//
+// Every protected function has a record in the `ollvm_integrity` section. The pass only knows the
+// function address; the size and expected hash are written by tools/integrity_patch.c after linking.
+// Each call to __ollvm_integrity_step() hashes at most INTEGRITY_CHUNK bytes and then returns, resuming
+// where it stopped on the next call, so coverage grows over time while the cost per check stays bounded.
+// Calls come from the cold paths the pass instruments, and optionally from a background thread
+// (set OLLVM_INTEGRITY_INTERVAL_MS).
+
+#include "integrity_hash.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define INTEGRITY_CHUNK   4096      // Bytes hashed per check, a multiple of INTEGRITY_BLOCK
+
+struct ollvm_region {
+    int64_t offset;                 // Function address minus the address of this record
+    uint32_t size;
+    uint32_t flags;
+    uint64_t hash;
+};
+
+extern struct ollvm_region __start_ollvm_integrity[] __attribute__((weak, visibility("hidden")));
+extern struct ollvm_region __stop_ollvm_integrity[] __attribute__((weak, visibility("hidden")));
+
+typedef void (*integrity_blocks_fn)(struct integrity_state *, const uint8_t *, size_t);
+
+static integrity_blocks_fn integrity_blocks = integrity_blocks_scalar;
+static pthread_mutex_t integrity_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ollvm_region *integrity_current;
+static size_t integrity_done;
+static struct integrity_state integrity_running;
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void integrity_blocks_avx2(struct integrity_state *state, const uint8_t *data, size_t count) {
+    __m256i lanes = _mm256_loadu_si256((const __m256i *)state->lanes);
+    const __m256i prime = _mm256_set1_epi32((int)INTEGRITY_PRIME);
+
+    for (size_t b = 0; b < count; ++b, data += INTEGRITY_BLOCK) {
+        __m256i x = _mm256_xor_si256(lanes, _mm256_loadu_si256((const __m256i *)data));
+        x = _mm256_or_si256(_mm256_slli_epi32(x, 13), _mm256_srli_epi32(x, 19));
+        lanes = _mm256_mullo_epi32(x, prime);
+    }
+    _mm256_storeu_si256((__m256i *)state->lanes, lanes);
+}
+
+__attribute__((target("sse4.1")))
+static void integrity_blocks_sse41(struct integrity_state *state, const uint8_t *data, size_t count) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)state->lanes);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(state->lanes + 4));
+    const __m128i prime = _mm_set1_epi32((int)INTEGRITY_PRIME);
+
+    for (size_t b = 0; b < count; ++b, data += INTEGRITY_BLOCK) {
+        __m128i x = _mm_xor_si128(lo, _mm_loadu_si128((const __m128i *)data));
+        __m128i y = _mm_xor_si128(hi, _mm_loadu_si128((const __m128i *)(data + 16)));
+        x = _mm_or_si128(_mm_slli_epi32(x, 13), _mm_srli_epi32(x, 19));
+        y = _mm_or_si128(_mm_slli_epi32(y, 13), _mm_srli_epi32(y, 19));
+        lo = _mm_mullo_epi32(x, prime);
+        hi = _mm_mullo_epi32(y, prime);
+    }
+    _mm_storeu_si128((__m128i *)state->lanes, lo);
+    _mm_storeu_si128((__m128i *)(state->lanes + 4), hi);
+}
+#endif
+
+// Programs can provide their own (strong) definition to choose how to react.
+__attribute__((weak)) void __ollvm_integrity_violation(const void *function) {
+    fprintf(stderr, "[!] Code integrity violation in function at %p\n", function);
+    abort();
+}
+
+static void integrity_next(void) {
+    integrity_current++;
+    if (integrity_current >= __stop_ollvm_integrity) integrity_current = __start_ollvm_integrity;
+    integrity_done = 0;
+    integrity_init(&integrity_running);
+}
+
+void __ollvm_integrity_step(void) {
+    size_t numRegions = __stop_ollvm_integrity - __start_ollvm_integrity;
+    if (!__start_ollvm_integrity || numRegions == 0) return;
+
+    // Never wait: if another thread is already checking, this check is simply skipped.
+    if (pthread_mutex_trylock(&integrity_lock)) return;
+
+    if (!integrity_current) {
+        integrity_current = __start_ollvm_integrity;
+        integrity_init(&integrity_running);
+    }
+
+    // Bounded by bytes and by regions: every finished or skipped region counts as a visit, so a
+    // check never goes around the section more than once, however small the regions are.
+    size_t budget = INTEGRITY_CHUNK;
+    size_t visited = 0;
+    while (budget >= INTEGRITY_BLOCK && visited < numRegions) {
+        struct ollvm_region *region = integrity_current;
+        if (!(region->flags & INTEGRITY_PATCHED)) {
+            visited++;
+            integrity_next();
+            continue;
+        }
+
+        const uint8_t *code = (const uint8_t *)region + region->offset;
+        size_t blocks = (region->size - integrity_done) / INTEGRITY_BLOCK;
+        if (blocks > budget / INTEGRITY_BLOCK) blocks = budget / INTEGRITY_BLOCK;
+
+        integrity_blocks(&integrity_running, code + integrity_done, blocks);
+        integrity_done += blocks * INTEGRITY_BLOCK;
+        budget -= blocks * INTEGRITY_BLOCK;
+
+        size_t left = region->size - integrity_done;
+        if (left < INTEGRITY_BLOCK) {
+            uint64_t hash = integrity_final(&integrity_running, code + integrity_done, left, region->size);
+            if (hash != region->hash) __ollvm_integrity_violation(code);
+            budget -= budget < INTEGRITY_BLOCK ? budget : INTEGRITY_BLOCK;             // The tail costs a block too
+            visited++;
+            integrity_next();
+        }
+    }
+
+    pthread_mutex_unlock(&integrity_lock);
+}
+
+static void *integrity_thread(void *arg) {
+    long intervalMs = (long)(intptr_t)arg;
+    struct timespec interval = { intervalMs / 1000, (intervalMs % 1000) * 1000000 };
+    for (;;) {
+        __ollvm_integrity_step();
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+__attribute__((constructor))
+static void integrity_setup(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        integrity_blocks = integrity_blocks_avx2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        integrity_blocks = integrity_blocks_sse41;
+    }
+#endif
+
+    const char *interval = getenv("OLLVM_INTEGRITY_INTERVAL_MS");
+    long intervalMs = interval ? atol(interval) : 0;
+    if (intervalMs > 0) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, integrity_thread, (void *)(intptr_t)intervalMs) == 0) {
+            pthread_detach(thread);
+        }
+    }
+}
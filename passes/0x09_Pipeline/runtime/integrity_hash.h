@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Hash shared by the runtime (integrity.c) and the post-link patcher (tools/integrity_patch.c).
+//
+// The input is consumed in 32-byte blocks, each one split into 8 independent 32-bit lanes, so a
+// block is a single AVX2 (or two SSE4.1) xor/rotate/multiply rounds. The last block is zero padded.
+
+#define INTEGRITY_BLOCK 32
+#define INTEGRITY_LANES 8
+#define INTEGRITY_PRIME 0x9E3779B1u
+
+#define INTEGRITY_PATCHED 1         // Record flag: size and hash were filled in by the patcher
+
+struct integrity_state {
+    uint32_t lanes[INTEGRITY_LANES];
+};
+
+static inline void integrity_init(struct integrity_state *state) {
+    for (unsigned i = 0; i < INTEGRITY_LANES; ++i) {
+        state->lanes[i] = 0x811C9DC5u + i * INTEGRITY_PRIME;
+    }
+}
+
+static inline uint32_t integrity_rotl(uint32_t x) {
+    return (x << 13) | (x >> 19);
+}
+
+// Hash `count` full blocks.
+static inline void integrity_blocks_scalar(struct integrity_state *state, const uint8_t *data, size_t count) {
+    for (size_t b = 0; b < count; ++b, data += INTEGRITY_BLOCK) {
+        for (unsigned i = 0; i < INTEGRITY_LANES; ++i) {
+            uint32_t word;
+            memcpy(&word, data + 4 * i, sizeof(word));
+            state->lanes[i] = integrity_rotl(state->lanes[i] ^ word) * INTEGRITY_PRIME;
+        }
+    }
+}
+
+// Hash the trailing partial block (if any) and fold the lanes and the length into 64 bits.
+static inline uint64_t integrity_final(struct integrity_state *state, const uint8_t *tail, size_t tailSize, size_t totalSize) {
+    if (tailSize) {
+        uint8_t block[INTEGRITY_BLOCK] = {0};
+        memcpy(block, tail, tailSize);
+        integrity_blocks_scalar(state, block, 1);
+    }
+
+    uint64_t hash = 0xCBF29CE484222325ull ^ totalSize;
+    for (unsigned i = 0; i < INTEGRITY_LANES; ++i) {
+        hash = (hash ^ state->lanes[i]) * 0x100000001B3ull;
+    }
+    return hash | 1;                                                    // 0 means "not patched yet"
+}
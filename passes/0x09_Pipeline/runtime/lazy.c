@@ -0,0 +1,86 @@
+// Runtime for the LazyDecrypt pass.
+//
+// Every encrypted function has a record in the `ollvm_lazy` section. The function itself is a stub that
+// calls __ollvm_lazy_decrypt() as long as the READY flag of its record is not set. The first call decrypts
+// the page-aligned body in place, sets the flag and, on x86-64, rewrites the NOP sled at the stub entry
+// into a jump to the body, so later calls skip the stub entirely.
+
+#include "lazy_cipher.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define LAZY_ENCRYPTED 1            // Record flag: written by tools/lazy_encrypt.c
+#define LAZY_READY     2            // Record flag: the body is decrypted, checked by the stub
+
+struct ollvm_lazy {
+    int64_t body;                   // Body address minus the address of this record
+    int64_t stub;                   // Stub address minus the address of this record
+    uint64_t key;
+    uint32_t size;
+    uint32_t flags;
+};
+
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Make the pages covering [start, start + size) writable, keeping them executable: other code may share
+// the first or last page and keep running while we write.
+static int lazy_unprotect(uint8_t *start, size_t size, int writable) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)start & ~(page - 1);
+    uintptr_t last = ((uintptr_t)start + size + page - 1) & ~(page - 1);
+    int prot = PROT_READ | PROT_EXEC | (writable ? PROT_WRITE : 0);
+    return mprotect((void *)first, last - first, prot);
+}
+
+// Replace the 8-byte NOP at the stub entry by `jmp body` with a single aligned store, so a thread that
+// enters the stub at the same time runs either the old stub (which still works) or the jump.
+static void lazy_patch_stub(uint8_t *stub, uint8_t *body) {
+#if defined(__x86_64__)
+    static const uint8_t nopl[4] = {0x0F, 0x1F, 0x84, 0x00};                        // nopl disp32(%rax,%rax,1), 8 bytes
+    if (((uintptr_t)stub & 7) || memcmp(stub, nopl, sizeof(nopl)) != 0) return;   // e.g. starts with endbr64
+
+    int64_t rel = body - (stub + 5);
+    if (rel != (int32_t)rel) return;
+
+    uint8_t code[8] = {0xE9, 0, 0, 0, 0, 0x0F, 0x1F, 0x00};                         // jmp rel32; nopl (%rax)
+    int32_t rel32 = (int32_t)rel;
+    memcpy(code + 1, &rel32, sizeof(rel32));
+
+    uint64_t word;
+    memcpy(&word, code, sizeof(word));
+    if (lazy_unprotect(stub, sizeof(word), 1) != 0) return;                        // W^X policy: keep using the stub
+    __atomic_store_n((uint64_t *)stub, word, __ATOMIC_RELEASE);
+    lazy_unprotect(stub, sizeof(word), 0);
+#else
+    (void)stub;
+    (void)body;
+#endif
+}
+
+void __ollvm_lazy_decrypt(struct ollvm_lazy *record) {
+    pthread_mutex_lock(&lazy_lock);
+
+    if (!(__atomic_load_n(&record->flags, __ATOMIC_RELAXED) & LAZY_READY)) {
+        uint8_t *body = (uint8_t *)record + record->body;
+        uint8_t *stub = (uint8_t *)record + record->stub;
+
+        if (record->flags & LAZY_ENCRYPTED) {
+            if (lazy_unprotect(body, record->size, 1) != 0) {
+                perror("[!] Can not decrypt function");
+                abort();
+            }
+            lazy_crypt(body, record->size, record->key);
+            lazy_unprotect(body, record->size, 0);
+            __builtin___clear_cache((char *)body, (char *)body + record->size);
+        }
+
+        lazy_patch_stub(stub, body);
+        __atomic_store_n(&record->flags, record->flags | LAZY_READY, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&lazy_lock);
+}
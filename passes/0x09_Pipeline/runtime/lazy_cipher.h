@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Stream cipher shared by the runtime (lazy.c) and the post-link tool (tools/lazy_encrypt.c).
+//
+// Every 8-byte word is xored with splitmix64(key + index), so encrypting and decrypting are the same
+// operation and words are independent of each other. This hides the code from static analysis; it is
+// not meant to resist someone who can read the key from the binary.
+
+static inline uint64_t lazy_keystream(uint64_t key, uint64_t index) {
+    uint64_t z = key + (index + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline void lazy_crypt(uint8_t *data, size_t size, uint64_t key) {
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        memcpy(&word, data + 8 * i, sizeof(word));
+        word ^= lazy_keystream(key, i);
+        memcpy(data + 8 * i, &word, sizeof(word));
+    }
+
+    uint64_t tail = lazy_keystream(key, words);
+    for (size_t i = words * 8; i < size; ++i, tail >>= 8) {
+        data[i] ^= (uint8_t)tail;
+    }
+}
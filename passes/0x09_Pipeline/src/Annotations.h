@@ -0,0 +1,58 @@
+#pragma once
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+// Annotation marking a function as sensitive: __attribute__((annotate("obfuscate")))
+#define OBFUSCATE_ANNOTATION "obfuscate"
+
+// Function attribute holding the level computed by ObfuscationLevels, from 0 (untouched) to OBFUSCATION_LEVEL_MAX
+#define OBFUSCATION_LEVEL_ATTRIBUTE "ollvm-level"
+#define OBFUSCATION_LEVEL_MAX 3
+
+// Function attribute marking the functions InlineHelpers made `alwaysinline`, so the attribute can be dropped again
+#define INLINE_HELPER_ATTRIBUTE "ollvm-inline-helper"
+
+// Function attribute set by LazyDecrypt on the stub and the body it creates, whose code changes at runtime
+#define LAZY_DECRYPT_ATTRIBUTE "ollvm-lazy"
+
+namespace {
+    // Functions carrying `__attribute__((annotate(annotation)))`. Clang collects those in the
+    // `llvm.global.annotations` array as { ptr function, ptr string, ptr file, i32 line, ptr args }.
+    SmallPtrSet<Function *, 16> getAnnotatedFunctions(Module &M, StringRef annotation) {
+        SmallPtrSet<Function *, 16> functions;
+
+        GlobalVariable *annotations = M.getNamedGlobal("llvm.global.annotations");
+        if (!annotations || !annotations->hasInitializer()) return functions;
+
+        auto *entries = dyn_cast<ConstantArray>(annotations->getInitializer());
+        if (!entries) return functions;
+
+        for (Value *entry : entries->operands()) {
+            auto *fields = dyn_cast<ConstantStruct>(entry);
+            if (!fields || fields->getNumOperands() < 2) continue;
+
+            auto *F = dyn_cast<Function>(fields->getOperand(0)->stripPointerCasts());
+            auto *str = dyn_cast<GlobalVariable>(fields->getOperand(1)->stripPointerCasts());
+            if (!F || !str || !str->hasInitializer()) continue;
+
+            auto *data = dyn_cast<ConstantDataSequential>(str->getInitializer());
+            if (data && data->isCString() && data->getAsCString() == annotation) functions.insert(F);
+        }
+        return functions;
+    }
+
+    // Functions without a level (no annotated roots in the module) get every pass, as before.
+    unsigned getObfuscationLevel(const Function &F) {
+        unsigned level;
+        Attribute attr = F.getFnAttribute(OBFUSCATION_LEVEL_ATTRIBUTE);
+        if (!attr.isStringAttribute() || attr.getValueAsString().getAsInteger(10, level)) return OBFUSCATION_LEVEL_MAX;
+        return level;
+    }
+}
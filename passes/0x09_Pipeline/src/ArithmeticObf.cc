@@ -10,6 +10,10 @@
 #include <vector>
 #include <string>
 
+#include "Annotations.h"
+#include "Log.h"
+#include "ObfuscationInfo.h"
+
 #define ITERNUM 10
 
 using namespace llvm;
@@ -62,30 +66,18 @@ namespace {
 
     struct ArithmeticObf : public PassInfoMixin<ArithmeticObf> {
         PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
-            errs() << formatv("\n[>] Arithmetic Obfuscation Pass\n");
+            logs() << formatv("\n[>] Arithmetic Obfuscation Pass\n");
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
             for (unsigned i = 0; i < ITERNUM; ++i) {
                 for (Function &F : M) {
                     if (F.isDeclaration()) continue;                                                    // Skip function declarations
+                    if (i >= ITERNUM * getObfuscationLevel(F) / OBFUSCATION_LEVEL_MAX) continue;        // Fewer rounds at lower levels
 
-                    std::vector<BinaryOperator*> worklist;                                              // List of instructions to modify
-
-                    for (BasicBlock &BB : F) {
-                        for (Instruction &I : BB) {
-                            if (auto *binOp = dyn_cast<BinaryOperator>(&I)) {
-                                if (binOp->getOpcode() == Instruction::Add ||
-                                    binOp->getOpcode() == Instruction::Sub ||
-                                    binOp->getOpcode() == Instruction::Xor ||
-                                    binOp->getOpcode() == Instruction::And ||
-                                    binOp->getOpcode() == Instruction::Or) {
-                                    worklist.push_back(binOp);                                          // Save to modify later
-                                    }
-                            }
-                        }
-                    }
+                    std::vector<BinaryOperator*> worklist = FAM.getResult<ObfuscationInfo>(F).candidateBinOps;   // List of instructions to modify
 
                     if (worklist.empty()) continue;
 
-                    errs() << formatv("[*] Targeting {0,10} instrs in function {1,-20}", worklist.size(), F.getName());
+                    logs() << formatv("[*] Targeting {0,10} instrs in function {1,-20}", worklist.size(), F.getName());
 
                     for (BinaryOperator *binOp : worklist) {
                         IRBuilder<NoFolder> builder(binOp);                                             // We use NoFolder to prevent constant folding
@@ -105,10 +97,13 @@ namespace {
                         binOp->eraseFromParent();
                     }
 
-                    errs() << "[Done]\n";
+                    PreservedAnalyses PA;                                                               // Only instructions changed, the CFG is intact
+                    PA.preserveSet<CFGAnalyses>();
+                    FAM.invalidate(F, PA);
+                    logs() << "[Done]\n";
                 }
             }
-            return PreservedAnalyses::all();
+            return PreservedAnalyses::none();
         }
     };
 }
@@ -0,0 +1,162 @@
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+
+#include "Annotations.h"
+#include "DebugLocs.h"
+#include "Log.h"
+#include "RandomKey.h"
+
+#define CONST_MAX_PER_FUNCTION 4    // Distinct constants kept live per function, the rest stay as immediates
+
+using namespace llvm;
+
+namespace {
+    struct ConstantObf : public PassInfoMixin<ConstantObf> {
+        // Operands that must stay literal (struct GEP indices, switch cases, immarg intrinsic
+        // parameters, ...) or that are much faster as immediates (divisors) are left alone.
+        static bool canEncode(Instruction &I, unsigned opIdx) {
+            if (isa<AllocaInst>(&I) || isa<GetElementPtrInst>(&I) || isa<SwitchInst>(&I)) return false;
+            if (isa<ExtractElementInst>(&I) || isa<InsertElementInst>(&I) || isa<ShuffleVectorInst>(&I)) return false;
+            if (I.isEHPad()) return false;
+
+            if (auto *CB = dyn_cast<CallBase>(&I)) {
+                if (isa<IntrinsicInst>(CB) || CB->isInlineAsm() || CB->isBundleOperand(opIdx)) return false;
+            }
+
+            if (auto *binOp = dyn_cast<BinaryOperator>(&I)) {
+                if (opIdx == 1 && (binOp->getOpcode() == Instruction::UDiv ||
+                                   binOp->getOpcode() == Instruction::SDiv ||
+                                   binOp->getOpcode() == Instruction::URem ||
+                                   binOp->getOpcode() == Instruction::SRem)) {
+                    return false;
+                }
+            }
+
+            auto *C = dyn_cast<ConstantInt>(I.getOperand(opIdx));
+            return C && C->getBitWidth() > 1 && C->getBitWidth() <= 64;
+        }
+
+        // The block a use needs its value in: the incoming block for PHI operands.
+        static BasicBlock *getUseBlock(Use *U) {
+            if (auto *PN = dyn_cast<PHINode>(U->getUser())) return PN->getIncomingBlock(*U);
+            return cast<Instruction>(U->getUser())->getParent();
+        }
+
+        // Find the nearest block that dominates every use and is not inside any loop, so the decode
+        // runs once per function invocation but the decoded value is not live across the whole function.
+        static BasicBlock *findDecodeBlock(const std::vector<Use *> &uses, DominatorTree &DT, LoopInfo &LI) {
+            // Only walk the tree for uses the current block does not dominate yet: the walk costs the depth
+            // of the use, and on long chains of blocks most uses are already covered.
+            BasicBlock *block = getUseBlock(uses.front());
+            for (Use *U : uses) {
+                BasicBlock *useBlock = getUseBlock(U);
+                if (!DT.dominates(block, useBlock)) block = DT.findNearestCommonDominator(block, useBlock);
+            }
+
+            while (Loop *L = LI.getLoopFor(block)) {
+                if (BasicBlock *preheader = L->getLoopPreheader()) {
+                    block = preheader;
+                } else {
+                    block = DT.getNode(L->getHeader())->getIDom()->getBlock();
+                }
+            }
+            return block;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Constant Obfuscation Pass\n");
+
+            auto &CTX = M.getContext();
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            IntegerType *int64Ty = IntegerType::getInt64Ty(CTX);
+
+            uint64_t keyValue = randomKey();
+            GlobalVariable *key = nullptr;
+            bool changed = false;
+
+            for (Function &F : M) {
+                if (F.isDeclaration() || getObfuscationLevel(F) == 0) continue;
+
+                DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+                LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+
+                // 1. Group the operands by constant, up to CONST_MAX_PER_FUNCTION distinct ones.
+                MapVector<ConstantInt *, std::vector<Use *>> worklist;
+                unsigned numUses = 0;
+                for (BasicBlock &BB : F) {
+                    if (!DT.isReachableFromEntry(&BB)) continue;
+                    for (Instruction &I : BB) {
+                        for (Use &U : I.operands()) {
+                            if (!canEncode(I, U.getOperandNo())) continue;
+
+                            auto *C = cast<ConstantInt>(U.get());
+                            if (!worklist.count(C) && worklist.size() >= CONST_MAX_PER_FUNCTION) continue;
+                            worklist[C].push_back(&U);                                                  // Save to modify later
+                            numUses++;
+                        }
+                    }
+                }
+
+                if (worklist.empty()) continue;
+
+                logs() << formatv("[*] Targeting {0,10} consts in function {1,-20}", numUses, F.getName());
+
+                if (!key) {
+                    key = new GlobalVariable(M, int64Ty, false, GlobalValue::PrivateLinkage,
+                                             ConstantInt::get(int64Ty, keyValue), "ollvm.ck");
+                }
+
+                // 2. Rebuild every constant once as `trunc(key) ^ (C ^ key)`, in the nearest block outside of
+                //    loops that dominates its uses. The key is read with a volatile load so it stays opaque.
+                //    Uses inside loops only see a register, and the value is not live before it is needed.
+                for (auto &[C, uses] : worklist) {
+                    BasicBlock *decodeBlock = findDecodeBlock(uses, DT, LI);
+
+                    // If the decode block holds uses itself, decode right before the first one.
+                    SmallPtrSet<User *, 8> users;
+                    for (Use *U : uses) {
+                        if (!isa<PHINode>(U->getUser())) users.insert(U->getUser());
+                    }
+                    Instruction *insertPt = decodeBlock->getTerminator();
+                    for (Instruction &I : *decodeBlock) {
+                        if (users.count(&I)) {
+                            insertPt = &I;
+                            break;
+                        }
+                    }
+
+                    IRBuilder<> builder(insertPt);
+                    builder.SetCurrentDebugLocation(artificialLoc(F));                              // Serves every use
+                    IntegerType *Ty = C->getType();
+                    LoadInst *opaqueKey = builder.CreateLoad(int64Ty, key, true, "ck.key");
+                    Value *typedKey = builder.CreateTrunc(opaqueKey, Ty, "ck.key");
+
+                    uint64_t mask = Ty->getBitWidth() == 64 ? ~0ULL : (1ULL << Ty->getBitWidth()) - 1;
+                    Constant *masked = ConstantInt::get(Ty, (C->getZExtValue() ^ keyValue) & mask);
+                    Value *encoded = builder.CreateXor(typedKey, masked, "ck");
+                    for (Use *U : uses) U->set(encoded);
+                }
+
+                changed = true;
+                logs() << "[Done]\n";
+            }
+            return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+        }
+    };
+}
@@ -1,7 +1,10 @@
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
@@ -9,44 +12,76 @@
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <vector>
 #include <map>
 
+#include "Annotations.h"
+#include "DebugLocs.h"
+#include "Log.h"
+#include "ObfuscationInfo.h"
+
 using namespace llvm;
 
 namespace {
 
     struct ControlFlowFlattening : public PassInfoMixin<ControlFlowFlattening> {
         PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
-            errs() << formatv("\n[>] Control Flow Flattening Pass\n");
+            logs() << formatv("\n[>] Control Flow Flattening Pass\n");
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
             for (Function &F : M) {
-                if (F.isDeclaration() || F.size() < 3) {
+                if (F.isDeclaration()) continue;
+                if (getObfuscationLevel(F) < 2) continue;                                   // Flattening is the most expensive pass
+
+                const FunctionFeatures &features = FAM.getResult<ObfuscationInfo>(F);
+                if (features.numBlocks < 3) {
                     continue;
                 }
 
-                bool hasPHINodes = false;
-                for (BasicBlock &BB : F) {
-                    if (isa<PHINode>(BB.front())) {
-                        hasPHINodes = true;
-                        break;
-                    }
+                if (features.hasPHI) {
+                    logs() << formatv("[*] Skipping function {0,-25} (contains PHI nodes)\n", F.getName());
+                    continue;
                 }
 
-                if (hasPHINodes) {
-                    errs() << formatv("[*] Skipping function {0,-25} (contains PHI nodes)\n", F.getName());
+                if (features.hasEH) {
+                    logs() << formatv("[*] Skipping function {0,-25} (uses exception handling)\n", F.getName());
                     continue;
                 }
 
-                errs() << formatv("[*] Flattening function {0,-40}", F.getName());
+                logs() << formatv("[*] Flattening function {0,-40}", F.getName());
 
                 auto &CTX = F.getContext();
                 IntegerType *int32Ty = IntegerType::getInt32Ty(CTX);
 
+
+                // 1. Record the profile of the original CFG before it disappears behind the dispatcher.
+                //    Branch weights come from `!prof` when present, and from the static heuristics otherwise.
+                BlockFrequencyInfo &BFI = FAM.getResult<BlockFrequencyAnalysis>(F);
+                BranchProbabilityInfo &BPI = FAM.getResult<BranchProbabilityAnalysis>(F);
+                MDBuilder MDB(CTX);
+
+                std::map<BasicBlock *, uint64_t> blockFreq;
+                std::map<BranchInst *, MDNode *> branchWeights;
+                for (BasicBlock &BB : F) {
+                    blockFreq[&BB] = BFI.getBlockFreq(&BB).getFrequency();
+
+                    auto *branch = dyn_cast<BranchInst>(BB.getTerminator());
+                    if (!branch || branch->isUnconditional()) continue;
+
+                    MDNode *weights = branch->getMetadata(LLVMContext::MD_prof);
+                    if (!weights) {
+                        weights = MDB.createBranchWeights(BPI.getEdgeProbability(&BB, 0u).getNumerator(),
+                                                          BPI.getEdgeProbability(&BB, 1u).getNumerator());
+                    }
+                    branchWeights[branch] = weights;
+                }
+
                 // 2. Prepare blocks for flattening.
                 BasicBlock *entryBlock = &F.getEntryBlock();
 
                 if (entryBlock->getTerminator()->getNumSuccessors() != 1) {
-                    entryBlock->splitBasicBlock(entryBlock->getTerminator(), "entry.split");
+                    BasicBlock *entrySplit = entryBlock->splitBasicBlock(entryBlock->getTerminator(), "entry.split");
+                    blockFreq[entrySplit] = blockFreq[entryBlock];
                 }
 
                 std::vector<BasicBlock *> originalBlocks;
@@ -65,9 +100,9 @@ namespace {
                 BasicBlock *defaultBlock = BasicBlock::Create(CTX, "defaultCase", &F);
 
                 new UnreachableInst(CTX, defaultBlock);
+                defaultBlock->getTerminator()->setDebugLoc(artificialLoc(F));
 
-                dispatcherBlock->moveAfter(entryBlock);
-                defaultBlock->moveAfter(dispatcherBlock);
+                dispatcherBlock->moveAfter(entryBlock);                                     // defaultBlock stays last, out of the hot path
 
                 // 4. Create the state variable at the TOP of the entry block.
                 IRBuilder<> allocaBuilder(&entryBlock->front());
@@ -91,6 +126,7 @@ namespace {
 
                 // 7. Build the switch statement in the dispatcher block.
                 IRBuilder<> dispatcherBuilder(dispatcherBlock);
+                dispatcherBuilder.SetCurrentDebugLocation(artificialLoc(F));                   // Shared by every edge, no single source line
                 Value *loadedState = dispatcherBuilder.CreateLoad(int32Ty, stateVar, "loadedState");
                 SwitchInst *dispatchSwitch = dispatcherBuilder.CreateSwitch(loadedState, defaultBlock, originalBlocks.size());
 
@@ -100,7 +136,22 @@ namespace {
                     block->moveAfter(lastBlock);
                 }
 
-                // 8. Rewrite the terminators of all original blocks.
+                // The default case is never taken, every state is weighted by how often its block ran, so
+                // the backend can still order the hot states first when lowering the switch.
+                uint64_t maxFreq = 0;
+                for (BasicBlock *BB : originalBlocks) maxFreq = std::max(maxFreq, blockFreq[BB]);
+
+                unsigned shift = 0;
+                while ((maxFreq >> shift) > UINT32_MAX) ++shift;
+
+                SmallVector<uint32_t, 16> caseWeights = {0};
+                for (auto &Case : dispatchSwitch->cases()) {
+                    caseWeights.push_back(blockFreq[Case.getCaseSuccessor()] >> shift);
+                }
+                dispatchSwitch->setMetadata(LLVMContext::MD_prof, MDB.createBranchWeights(caseWeights));
+
+                // 8. Rewrite the terminators of all original blocks. The builder gives the state updates
+                //    the location of the terminator they replace.
                 for (BasicBlock *BB : originalBlocks) {
                     Instruction *terminator = BB->getTerminator();
                     IRBuilder<> builder(terminator);
@@ -121,6 +172,9 @@ namespace {
                             Value *trueId = ConstantInt::get(int32Ty, blockToIdMap[trueDest]);
                             Value *falseId = ConstantInt::get(int32Ty, blockToIdMap[falseDest]);
                             Value *nextState = builder.CreateSelect(condition, trueId, falseId, "nextState");
+                            if (auto *select = dyn_cast<SelectInst>(nextState)) {
+                                select->setMetadata(LLVMContext::MD_prof, branchWeights[branch]);
+                            }
                             builder.CreateStore(nextState, stateVar);
                             builder.CreateBr(dispatcherBlock);
                         }
@@ -144,7 +198,8 @@ namespace {
                     AI->moveBefore(InsertPt);
                 }
 
-                errs() << "[Done]\n";
+                FAM.invalidate(F, PreservedAnalyses::none());
+                logs() << "[Done]\n";
             }
             return PreservedAnalyses::none();
         }
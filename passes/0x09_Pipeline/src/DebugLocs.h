@@ -0,0 +1,17 @@
+#pragma once
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/Function.h"
+
+using namespace llvm;
+
+namespace {
+    // Location for code that stands for no source line at all (dispatchers, hoisted decodes, ...):
+    // line 0 in the scope of F. Profilers still attribute its samples to F, without blaming an
+    // unrelated line, and sample-PGO ignores it. Empty when F has no debug info.
+    DebugLoc artificialLoc(Function &F) {
+        if (DISubprogram *SP = F.getSubprogram()) return DILocation::get(F.getContext(), 0, 0, SP);
+        return DebugLoc();
+    }
+}
@@ -0,0 +1,150 @@
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <vector>
+
+#include "Annotations.h"
+#include "DebugLocs.h"
+#include "Log.h"
+#include "RandomKey.h"
+
+using namespace llvm;
+
+namespace {
+    struct IndirectCall : public PassInfoMixin<IndirectCall> {
+        // A call target as seen from one function: every call site of `Callee` inside
+        // that function shares a single table slot, key and decoded pointer.
+        struct Target {
+            std::vector<CallBase *> callSites;
+            unsigned slot = 0;
+            uint64_t key = 0;
+        };
+
+        static bool isEligible(CallBase *CB) {
+            Function *callee = CB->getCalledFunction();
+            if (!callee || callee->isIntrinsic()) return false;
+            if (CB->isInlineAsm() || CB->isMustTailCall()) return false;
+            if (isa<CallBrInst>(CB)) return false;
+            return true;
+        }
+
+        // Find a block that dominates every call site and is not inside any loop, so the
+        // decode runs once per function invocation instead of once per iteration.
+        static BasicBlock *findDecodeBlock(const std::vector<CallBase *> &callSites, DominatorTree &DT, LoopInfo &LI) {
+            BasicBlock *block = callSites.front()->getParent();
+            for (CallBase *CB : callSites) {
+                block = DT.findNearestCommonDominator(block, CB->getParent());
+            }
+
+            while (Loop *L = LI.getLoopFor(block)) {
+                if (BasicBlock *preheader = L->getLoopPreheader()) {
+                    block = preheader;
+                } else {
+                    block = DT.getNode(L->getHeader())->getIDom()->getBlock();
+                }
+            }
+            return block;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Indirect Call Pass\n");
+
+            auto &CTX = M.getContext();
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            PointerType *ptrTy = PointerType::getUnqual(CTX);
+            IntegerType *int8Ty = IntegerType::getInt8Ty(CTX);
+            IntegerType *intPtrTy = M.getDataLayout().getIntPtrType(CTX);
+
+            // Keys use the whole pointer width, so the offsets cover the address space
+            unsigned ptrBits = intPtrTy->getBitWidth();
+            uint64_t keyMask = ptrBits == 64 ? ~0ULL : (1ULL << ptrBits) - 1;
+
+            // 1. Collect the direct call sites of every function, grouped by callee.
+            std::vector<Constant *> tableEntries;
+            std::map<Function *, std::map<Function *, Target>> targetsPerFunction;
+
+            for (Function &F : M) {
+                if (F.isDeclaration() || getObfuscationLevel(F) == 0) continue;
+
+                DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+                auto &targets = targetsPerFunction[&F];
+
+                for (BasicBlock &BB : F) {
+                    if (!DT.isReachableFromEntry(&BB)) continue;
+                    for (Instruction &I : BB) {
+                        auto *CB = dyn_cast<CallBase>(&I);
+                        if (!CB || !isEligible(CB)) continue;
+                        targets[CB->getCalledFunction()].callSites.push_back(CB);       // Save to modify later
+                    }
+                }
+
+                // 2. Give each (function, callee) pair its own slot holding `callee + key`.
+                for (auto &[callee, target] : targets) {
+                    target.slot = tableEntries.size();
+                    target.key = randomKey() & keyMask;
+                    tableEntries.push_back(ConstantExpr::getGetElementPtr(int8Ty, callee, ConstantInt::get(intPtrTy, target.key)));
+                }
+            }
+
+            if (tableEntries.empty()) return PreservedAnalyses::all();
+
+            ArrayType *tableTy = ArrayType::get(ptrTy, tableEntries.size());
+            auto *table = new GlobalVariable(M, tableTy, false, GlobalValue::PrivateLinkage,
+                                             ConstantArray::get(tableTy, tableEntries), "ollvm.ict");
+
+            // 3. Decode each target once, outside of loops, and route every call site through it.
+            for (auto &[F, targets] : targetsPerFunction) {
+                if (targets.empty()) continue;
+
+                DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(*F);
+                LoopInfo &LI = FAM.getResult<LoopAnalysis>(*F);
+
+                unsigned numCalls = 0;
+                for (auto &[callee, target] : targets) numCalls += target.callSites.size();
+
+                logs() << formatv("[*] Targeting {0,10} calls in function {1,-20}", numCalls, F->getName());
+
+                for (auto &[callee, target] : targets) {
+                    BasicBlock *decodeBlock = findDecodeBlock(target.callSites, DT, LI);
+
+                    // If the decode block holds call sites itself, decode right before the first one.
+                    Instruction *insertPt = decodeBlock->getTerminator();
+                    for (Instruction &I : *decodeBlock) {
+                        auto *CB = dyn_cast<CallBase>(&I);
+                        if (CB && CB->getCalledFunction() == callee && isEligible(CB)) {
+                            insertPt = CB;
+                            break;
+                        }
+                    }
+
+                    // The load is volatile so the optimizer can not fold the table back into a direct call.
+                    IRBuilder<> builder(insertPt);
+                    if (insertPt->isTerminator()) builder.SetCurrentDebugLocation(artificialLoc(*F));   // Hoisted away from the calls
+                    Value *slotPtr = builder.CreateConstInBoundsGEP2_32(tableTy, table, 0, target.slot, "ict.slot");
+                    LoadInst *encoded = builder.CreateLoad(ptrTy, slotPtr, true, "ict.enc");
+                    Value *decoded = builder.CreateGEP(int8Ty, encoded, ConstantInt::get(intPtrTy, -target.key & keyMask), "ict.dec");
+
+                    for (CallBase *CB : target.callSites) {
+                        CB->setCalledOperand(decoded);
+                    }
+                }
+
+                logs() << "[Done]\n";
+            }
+            return PreservedAnalyses::none();
+        }
+    };
+}
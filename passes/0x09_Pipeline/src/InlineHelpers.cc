@@ -0,0 +1,84 @@
+#include "llvm/Analysis/LazyCallGraph.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Annotations.h"
+#include "Log.h"
+#include "ObfuscationInfo.h"
+
+#define INLINE_HELPER_MAX_INSTRS 16 // Functions up to this size are inlined before being obfuscated
+
+using namespace llvm;
+
+namespace {
+    // Marks small helpers (accessors, `add` in test.cc, ...) always-inline, so the AlwaysInlinerPass
+    // scheduled right after it folds them into their callers before the obfuscation passes run.
+    // Once obfuscated they would be far too big for the regular inliner, and every caller would
+    // keep paying for a real call. The attribute is dropped again by StripHelperInline once the
+    // inliner ran, so it never reaches the object file, LTO or the other TUs calling the helper.
+    struct InlineHelpers : public PassInfoMixin<InlineHelpers> {
+        static bool isHelper(Function &F, const FunctionFeatures &features) {
+            if (features.numInstructions > INLINE_HELPER_MAX_INSTRS || features.hasEH) return false;
+            if (F.isVarArg() || F.use_empty()) return false;
+            if (F.hasFnAttribute(Attribute::NoInline) || F.hasFnAttribute(Attribute::OptimizeNone)) return false;
+
+            for (User *U : F.users()) {
+                auto *CB = dyn_cast<CallBase>(U);
+                if (CB && CB->getFunction() == &F) return false;                                  // Recursive
+            }
+            return true;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Inline Helpers Pass\n");
+
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            SmallPtrSet<Function *, 16> sensitive = getAnnotatedFunctions(M, OBFUSCATE_ANNOTATION);
+
+            // Functions on a call cycle can never be inlined completely.
+            SmallPtrSet<Function *, 16> recursive;
+            LazyCallGraph &CG = AM.getResult<LazyCallGraphAnalysis>(M);
+            CG.buildRefSCCs();
+            for (LazyCallGraph::RefSCC &RC : CG.postorder_ref_sccs()) {
+                for (LazyCallGraph::SCC &C : RC) {
+                    if (C.size() < 2) continue;
+                    for (LazyCallGraph::Node &N : C) recursive.insert(&N.getFunction());
+                }
+            }
+
+            bool changed = false;
+            for (Function &F : M) {
+                if (F.isDeclaration() || sensitive.count(&F) || recursive.count(&F)) continue;
+                if (!isHelper(F, FAM.getResult<ObfuscationInfo>(F))) continue;
+
+                logs() << formatv("[*] Inlining helper {0,-40}[Done]\n", F.getName());
+                F.addFnAttr(Attribute::AlwaysInline);
+                F.addFnAttr(INLINE_HELPER_ATTRIBUTE);
+                changed = true;
+            }
+            return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+        }
+    };
+
+    // Runs after the AlwaysInlinerPass: the helpers that are still around (external ones, or ones
+    // whose address is taken) go back to the regular inlining heuristics.
+    struct StripHelperInline : public PassInfoMixin<StripHelperInline> {
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+            bool changed = false;
+            for (Function &F : M) {
+                if (!F.hasFnAttribute(INLINE_HELPER_ATTRIBUTE)) continue;
+
+                F.removeFnAttr(Attribute::AlwaysInline);
+                F.removeFnAttr(INLINE_HELPER_ATTRIBUTE);
+                changed = true;
+            }
+            return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+        }
+    };
+}
@@ -0,0 +1,129 @@
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
+
+#include "Annotations.h"
+#include "Log.h"
+
+#define INTEGRITY_COLD_RATIO 16     // A block is cold when it runs at most 1/16 as often as the function entry
+
+using namespace llvm;
+
+namespace {
+    struct IntegrityCheck : public PassInfoMixin<IntegrityCheck> {
+        // The record must be resolvable at link time (`fn - &record`), which rules out functions
+        // that can be preempted, and the runtime itself must not check its own progress. Code
+        // that LazyDecrypt rewrites at runtime can not have a fixed hash.
+        static bool isEligible(Function &F) {
+            if (F.isDeclaration() || F.hasAvailableExternallyLinkage()) return false;
+            if (F.getName().starts_with("__ollvm_")) return false;
+            if (F.hasFnAttribute(LAZY_DECRYPT_ATTRIBUTE)) return false;                        // Decrypted and patched at runtime
+            return F.isDSOLocal() || F.hasLocalLinkage();
+        }
+
+        // Blocks that never run: the `.dummy` blocks of SplitBasicBlocks, only reached through the untaken
+        // side of a constant branch, and the `defaultCase` of ControlFlowFlattening, a bare `unreachable`.
+        // An `unreachable` after a call (exit, abort, ...) is an error path, which does run.
+        static bool isNeverExecuted(BasicBlock &BB, BlockFrequencyInfo &BFI) {
+            if (BFI.getBlockFreq(&BB).getFrequency() == 0) return true;
+
+            bool onlyUntakenEdges = !pred_empty(&BB);
+            for (BasicBlock *pred : predecessors(&BB)) {
+                auto *BI = dyn_cast<BranchInst>(pred->getTerminator());
+                auto *cond = BI && BI->isConditional() ? dyn_cast<ConstantInt>(BI->getCondition()) : nullptr;
+                if (!cond || BI->getSuccessor(cond->isZero() ? 1 : 0) == &BB) onlyUntakenEdges = false;
+            }
+            if (onlyUntakenEdges) return true;
+
+            if (!isa<UnreachableInst>(BB.getTerminator())) return false;
+            for (Instruction &I : BB) {
+                if (isa<CallBase>(&I)) return false;
+            }
+            return true;
+        }
+
+        // First block that runs rarely compared to the entry (error paths, ...), if any.
+        static BasicBlock *findColdBlock(Function &F, BlockFrequencyInfo &BFI) {
+            if (F.hasFnAttribute(Attribute::Cold)) return &F.getEntryBlock();
+
+            uint64_t entryFreq = BFI.getEntryFreq().getFrequency();
+            for (BasicBlock &BB : F) {
+                if (&BB == &F.getEntryBlock() || BB.isEHPad() || isNeverExecuted(BB, BFI)) continue;
+                if (BFI.getBlockFreq(&BB).getFrequency() * INTEGRITY_COLD_RATIO <= entryFreq) return &BB;
+            }
+            return nullptr;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Integrity Check Pass\n");
+
+            auto &CTX = M.getContext();
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            IntegerType *int32Ty = IntegerType::getInt32Ty(CTX);
+            IntegerType *int64Ty = IntegerType::getInt64Ty(CTX);
+
+            // Must match `struct ollvm_region` in runtime/integrity.c
+            StructType *regionTy = StructType::get(CTX, {int64Ty, int32Ty, int32Ty, int64Ty});
+
+            FunctionCallee step = M.getOrInsertFunction("__ollvm_integrity_step", Type::getVoidTy(CTX));
+            if (auto *stepFn = dyn_cast<Function>(step.getCallee())) {
+                stepFn->addFnAttr(Attribute::Cold);
+                stepFn->addFnAttr(Attribute::NoUnwind);
+            }
+
+            std::vector<Function *> worklist;
+            for (Function &F : M) {
+                if (isEligible(F)) worklist.push_back(&F);                                      // Save to modify later
+            }
+
+            std::vector<GlobalValue *> regions;
+            unsigned numChecks = 0;
+            for (Function *F : worklist) {
+                // 1. Emit the region record. Size and hash stay zero until the post-link patcher fills them.
+                auto *region = new GlobalVariable(M, regionTy, false, GlobalValue::PrivateLinkage, nullptr, "ollvm.region");
+                Constant *offset = ConstantExpr::getSub(ConstantExpr::getPtrToInt(F, int64Ty),
+                                                        ConstantExpr::getPtrToInt(region, int64Ty));
+                region->setInitializer(ConstantStruct::get(regionTy, {offset, ConstantInt::get(int32Ty, 0),
+                                                                      ConstantInt::get(int32Ty, 0), ConstantInt::get(int64Ty, 0)}));
+                region->setSection("ollvm_integrity");
+                region->setAlignment(Align(8));
+                regions.push_back(region);
+
+                // 2. Trigger an incremental check from a cold path, never from the hot ones.
+                BasicBlock *coldBlock = findColdBlock(*F, FAM.getResult<BlockFrequencyAnalysis>(*F));
+                if (!coldBlock) continue;
+
+                IRBuilder<> builder(&*coldBlock->getFirstInsertionPt());
+                builder.CreateCall(step);
+                numChecks++;
+
+                // The optimizer already inferred attributes from the body, and the check breaks them:
+                // it reads and writes the runtime state, takes a lock and may abort.
+                F->removeFnAttr(Attribute::Memory);
+                F->removeFnAttr(Attribute::NoSync);
+                F->removeFnAttr(Attribute::WillReturn);
+                F->removeFnAttr(Attribute::NoUnwind);
+            }
+
+            if (regions.empty()) return PreservedAnalyses::all();
+            appendToUsed(M, regions);
+
+            logs() << formatv("[*] Protecting {0,10} functions, {1} checks on cold paths\n", regions.size(), numChecks);
+            return PreservedAnalyses::none();
+        }
+    };
+}
@@ -0,0 +1,153 @@
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <vector>
+
+#include "Annotations.h"
+#include "Log.h"
+
+#define LAZY_PAGE_SIZE 4096         // Encrypted bodies start on their own page
+#define LAZY_PATCH_BYTES "8"        // NOP bytes at the stub entry, replaced by a jump to the body once decrypted
+#define LAZY_READY 2                // Record flag: the body is decrypted (must match runtime/lazy.c)
+
+using namespace llvm;
+
+namespace {
+    // Keeps the body of every sensitive function encrypted in the binary until its first call.
+    // The function itself becomes a stub that checks the record's flags and calls the runtime to
+    // decrypt the body on the first call; the runtime then patches the stub into a direct jump.
+    struct LazyDecrypt : public PassInfoMixin<LazyDecrypt> {
+        // The record must be resolvable at link time, like the IntegrityCheck ones, and the body must
+        // be movable into a new function that the stub can tail call with the very same arguments.
+        static bool isEligible(Function &F) {
+            if (F.isDeclaration() || F.isVarArg() || F.hasComdat()) return false;
+            if (!F.isDSOLocal() && !F.hasLocalLinkage()) return false;
+            if (F.hasFnAttribute(Attribute::Naked) || F.hasPrefixData() || F.hasPrologueData()) return false;
+
+            for (BasicBlock &BB : F) {
+                if (BB.hasAddressTaken()) return false;
+            }
+            return true;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Lazy Decrypt Pass\n");
+
+            if (!Triple(M.getTargetTriple()).isOSBinFormatELF()) return PreservedAnalyses::all();
+
+            SmallPtrSet<Function *, 16> sensitive = getAnnotatedFunctions(M, OBFUSCATE_ANNOTATION);
+            std::vector<Function *> worklist;
+            for (Function &F : M) {
+                if (sensitive.count(&F) && isEligible(F)) worklist.push_back(&F);               // Save to modify later
+            }
+            if (worklist.empty()) return PreservedAnalyses::all();
+
+            auto &CTX = M.getContext();
+            IntegerType *int32Ty = IntegerType::getInt32Ty(CTX);
+            IntegerType *int64Ty = IntegerType::getInt64Ty(CTX);
+            MDBuilder MDB(CTX);
+
+            // Must match `struct ollvm_lazy` in runtime/lazy.c
+            StructType *recordTy = StructType::get(CTX, {int64Ty, int64Ty, int64Ty, int32Ty, int32Ty});
+
+            FunctionCallee decrypt = M.getOrInsertFunction("__ollvm_lazy_decrypt", Type::getVoidTy(CTX), PointerType::getUnqual(CTX));
+            if (auto *decryptFn = dyn_cast<Function>(decrypt.getCallee())) {
+                decryptFn->addFnAttr(Attribute::Cold);
+                decryptFn->addFnAttr(Attribute::NoUnwind);
+            }
+
+            std::vector<GlobalValue *> records;
+            for (Function *F : worklist) {
+                logs() << formatv("[*] Encrypting function {0,-40}", F->getName());
+
+                // 1. Move the body into its own page-aligned function in the encrypted section.
+                Function *body = Function::Create(F->getFunctionType(), GlobalValue::InternalLinkage, F->getAddressSpace(),
+                                                  F->getName() + ".ollvm.body", &M);
+                body->copyAttributesFrom(F);
+                body->setLinkage(GlobalValue::InternalLinkage);
+                body->setVisibility(GlobalValue::DefaultVisibility);
+                body->setSection("ollvm_encrypted");
+                body->setAlignment(Align(LAZY_PAGE_SIZE));
+                body->removeFnAttr(Attribute::AlwaysInline);
+                body->addFnAttr(Attribute::NoInline);                                           // Must stay in its section
+                body->addFnAttr(LAZY_DECRYPT_ATTRIBUTE);
+                body->splice(body->end(), F);
+                body->setSubprogram(F->getSubprogram());
+                F->setSubprogram(nullptr);
+                F->setPersonalityFn(nullptr);
+
+                auto newArg = body->arg_begin();
+                for (Argument &arg : F->args()) {
+                    newArg->takeName(&arg);
+                    arg.replaceAllUsesWith(&*newArg++);
+                }
+
+                // 2. Emit the record. Size and key stay zero until the post-link tool encrypts the body.
+                auto *record = new GlobalVariable(M, recordTy, false, GlobalValue::PrivateLinkage, nullptr, "ollvm.lazy");
+                auto offsetOf = [&](GlobalValue *GV) {
+                    return ConstantExpr::getSub(ConstantExpr::getPtrToInt(GV, int64Ty), ConstantExpr::getPtrToInt(record, int64Ty));
+                };
+                record->setInitializer(ConstantStruct::get(recordTy, {offsetOf(body), offsetOf(F), ConstantInt::get(int64Ty, 0),
+                                                                      ConstantInt::get(int32Ty, 0), ConstantInt::get(int32Ty, 0)}));
+                record->setSection("ollvm_lazy");
+                record->setAlignment(Align(8));
+                records.push_back(record);
+
+                // 3. Turn the function into the stub: decrypt once, then always tail call the body.
+                //    The patchable entry gives the runtime room for a jump that skips the stub entirely.
+                F->addFnAttr(Attribute::NoInline);
+                F->removeFnAttr(Attribute::AlwaysInline);
+                F->removeFnAttr(Attribute::Memory);                                             // The stub reads its record and may call the runtime
+                F->removeFnAttr(Attribute::NoSync);
+                F->addFnAttr(LAZY_DECRYPT_ATTRIBUTE);
+                F->addFnAttr("patchable-function-entry", LAZY_PATCH_BYTES);
+                F->setAlignment(Align(16));
+
+                BasicBlock *entry = BasicBlock::Create(CTX, "entry", F);
+                BasicBlock *decryptBlock = BasicBlock::Create(CTX, "decrypt", F);
+                BasicBlock *callBlock = BasicBlock::Create(CTX, "call", F);
+
+                IRBuilder<> builder(entry);
+                LoadInst *flags = builder.CreateAlignedLoad(int32Ty, builder.CreateStructGEP(recordTy, record, 4), Align(4), "flags");
+                flags->setAtomic(AtomicOrdering::Acquire);
+                Value *ready = builder.CreateICmpNE(builder.CreateAnd(flags, LAZY_READY), builder.getInt32(0), "ready");
+                builder.CreateCondBr(ready, callBlock, decryptBlock, MDB.createBranchWeights((1u << 20) - 1, 1));
+
+                builder.SetInsertPoint(decryptBlock);
+                builder.CreateCall(decrypt, {record});
+                builder.CreateBr(callBlock);
+
+                builder.SetInsertPoint(callBlock);
+                std::vector<Value *> args;
+                for (Argument &arg : F->args()) args.push_back(&arg);
+                CallInst *call = builder.CreateCall(body, args);
+                call->setCallingConv(body->getCallingConv());
+                call->setAttributes(F->getAttributes().removeFnAttributes(CTX));
+                call->setTailCallKind(CallInst::TCK_MustTail);
+                if (F->getReturnType()->isVoidTy()) {
+                    builder.CreateRetVoid();
+                } else {
+                    builder.CreateRet(call);
+                }
+
+                logs() << "[Done]\n";
+            }
+
+            appendToUsed(M, records);
+            return PreservedAnalyses::none();
+        }
+    };
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+    // Where the passes report their progress: errs(), unless the thread running them redirects it.
+    // The compile server gives every job its own buffer and prints it in one piece, so the output
+    // of concurrent jobs is not interleaved.
+    thread_local raw_ostream *passLog = nullptr;
+
+    raw_ostream &logs() {
+        return passLog ? *passLog : errs();
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PassManager.h"
+
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+    // Everything the obfuscation passes need to know to decide if (and where) to touch a function.
+    // It is computed with a single walk over the function and cached by the FunctionAnalysisManager,
+    // so a pass that modifies a function has to invalidate it (FAM.invalidate) before asking again.
+    struct FunctionFeatures {
+        bool hasPHI = false;
+        bool hasEH = false;
+        unsigned numBlocks = 0;
+        unsigned numInstructions = 0;
+        std::vector<BinaryOperator *> candidateBinOps;          // Add, Sub, Xor, And, Or
+        std::vector<BasicBlock *> splittableBlocks;             // At least 3 instructions and no PHI nodes
+    };
+
+    struct ObfuscationInfo : public AnalysisInfoMixin<ObfuscationInfo> {
+        using Result = FunctionFeatures;
+
+        Result run(Function &F, FunctionAnalysisManager &) {
+            Result features;
+
+            features.hasEH = F.hasPersonalityFn();
+            for (BasicBlock &BB : F) {
+                unsigned size = 0;
+                bool blockHasPHI = false;
+                for (Instruction &I : BB) {
+                    ++size;
+                    if (isa<PHINode>(&I)) blockHasPHI = true;
+                    if (I.isEHPad() || isa<InvokeInst>(&I)) features.hasEH = true;
+
+                    if (auto *binOp = dyn_cast<BinaryOperator>(&I)) {
+                        if (binOp->getOpcode() == Instruction::Add ||
+                            binOp->getOpcode() == Instruction::Sub ||
+                            binOp->getOpcode() == Instruction::Xor ||
+                            binOp->getOpcode() == Instruction::And ||
+                            binOp->getOpcode() == Instruction::Or) {
+                            features.candidateBinOps.push_back(binOp);
+                        }
+                    }
+                }
+
+                features.hasPHI |= blockHasPHI;
+                features.numBlocks++;
+                features.numInstructions += size;
+                if (size >= 3 && !blockHasPHI) features.splittableBlocks.push_back(&BB);
+            }
+            return features;
+        }
+
+        static AnalysisKey Key;
+    };
+
+    AnalysisKey ObfuscationInfo::Key;
+}
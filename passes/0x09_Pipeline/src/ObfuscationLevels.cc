@@ -0,0 +1,154 @@
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LazyCallGraph.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Annotations.h"
+#include "Log.h"
+
+#define LEVEL_HOT_RATIO 4           // Without a profile, a function is hot when one of its calls runs at least 4 times per call of its caller
+#define LEVEL_SHARED_CALLERS 4      // A hot function with this many callers is a shared utility
+
+using namespace llvm;
+
+namespace {
+    // Gives every function an obfuscation level, starting at OBFUSCATION_LEVEL_MAX for the annotated
+    // roots and decaying along the call graph: one level per call, two into a hot function.
+    // Propagation stops at shared hot utilities (memcpy-like helpers called from everywhere), so
+    // the helpers of a sensitive function are protected but the hot common code stays fast.
+    // Functions not reached from a root get `defaultLevel` (0 unless -ollvm-default-level says otherwise).
+    struct ObfuscationLevels : public PassInfoMixin<ObfuscationLevels> {
+        unsigned defaultLevel;
+        std::map<Function *, unsigned> levels;
+        std::map<Function *, unsigned> numCallers;
+        std::map<Function *, bool> hotness;
+
+        ObfuscationLevels(unsigned defaultLevel = 0) : defaultLevel(std::min<unsigned>(defaultLevel, OBFUSCATION_LEVEL_MAX)) {}
+
+        unsigned countCallers(Function *F) {
+            auto it = numCallers.find(F);
+            if (it != numCallers.end()) return it->second;
+
+            SmallPtrSet<Function *, 8> callers;
+            for (User *U : F->users()) {
+                auto *CB = dyn_cast<CallBase>(U);
+                if (CB && CB->getCalledFunction() == F) callers.insert(CB->getFunction());
+            }
+            return numCallers[F] = callers.size();
+        }
+
+        // Whether F itself runs often, whichever caller is looking at it: hot by its profile entry count
+        // when there is one, or else called from a block that runs at least LEVEL_HOT_RATIO times per
+        // call of its caller (from a loop) somewhere in the module.
+        bool isHot(Function *F, ProfileSummaryInfo &PSI, FunctionAnalysisManager &FAM) {
+            auto it = hotness.find(F);
+            if (it != hotness.end()) return it->second;
+
+            if (PSI.hasProfileSummary() && F->getEntryCount()) return hotness[F] = PSI.isFunctionEntryHot(F);
+
+            bool hot = false;
+            for (User *U : F->users()) {
+                auto *CB = dyn_cast<CallBase>(U);
+                if (!CB || CB->getCalledFunction() != F) continue;
+
+                BlockFrequencyInfo &BFI = FAM.getResult<BlockFrequencyAnalysis>(*CB->getFunction());
+                if (BFI.getBlockFreq(CB->getParent()).getFrequency() >= BFI.getEntryFreq().getFrequency() * LEVEL_HOT_RATIO) {
+                    hot = true;
+                    break;
+                }
+            }
+            return hotness[F] = hot;
+        }
+
+        // Push the level of F to its direct callees. Returns true if any callee level was raised.
+        bool propagate(Function &F, const SmallPtrSet<Function *, 16> &roots, ProfileSummaryInfo &PSI,
+                       FunctionAnalysisManager &FAM) {
+            unsigned level = levels[&F];
+            if (level == 0 || F.isDeclaration()) return false;
+
+            bool changed = false;
+            for (BasicBlock &BB : F) {
+                for (Instruction &I : BB) {
+                    auto *CB = dyn_cast<CallBase>(&I);
+                    Function *callee = CB ? CB->getCalledFunction() : nullptr;
+                    if (!callee || callee->isDeclaration() || roots.count(callee)) continue;
+
+                    bool hot = isHot(callee, PSI, FAM);
+                    if (hot && countCallers(callee) >= LEVEL_SHARED_CALLERS) continue;            // Shared hot utility
+
+                    unsigned decay = hot ? 2 : 1;
+                    unsigned &calleeLevel = levels[callee];
+                    if (level > decay && level - decay > calleeLevel) {
+                        calleeLevel = level - decay;
+                        changed = true;
+                    }
+                }
+            }
+            return changed;
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Obfuscation Levels Pass\n");
+
+            // Without roots, or when unreached code gets every pass anyway, there is nothing to select
+            SmallPtrSet<Function *, 16> roots = getAnnotatedFunctions(M, OBFUSCATE_ANNOTATION);
+            if (roots.empty() || defaultLevel >= OBFUSCATION_LEVEL_MAX) return PreservedAnalyses::all();
+
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            auto &PSI = AM.getResult<ProfileSummaryAnalysis>(M);
+            LazyCallGraph &CG = AM.getResult<LazyCallGraphAnalysis>(M);
+            levels.clear();
+            numCallers.clear();
+            hotness.clear();
+            for (Function *F : roots) levels[F] = OBFUSCATION_LEVEL_MAX;
+
+            // 1. Order the SCCs so that callers come before their callees (reverse post-order).
+            std::vector<LazyCallGraph::SCC *> order;
+            CG.buildRefSCCs();
+            for (LazyCallGraph::RefSCC &RC : CG.postorder_ref_sccs()) {
+                for (LazyCallGraph::SCC &C : RC) order.push_back(&C);
+            }
+            std::reverse(order.begin(), order.end());
+
+            // 2. Push the levels down. Inside a recursive SCC a level can travel around the cycle,
+            //    so its members are revisited until nothing changes (levels only ever go up).
+            for (LazyCallGraph::SCC *C : order) {
+                bool changed = true;
+                while (changed) {
+                    changed = false;
+                    for (LazyCallGraph::Node &N : *C) changed |= propagate(N.getFunction(), roots, PSI, FAM);
+                    if (C->size() == 1) break;
+                }
+            }
+
+            // 3. Record the result for the obfuscation passes.
+            unsigned numProtected = 0, numDefined = 0;
+            for (Function &F : M) {
+                if (F.isDeclaration()) continue;
+
+                unsigned level = std::max(levels[&F], defaultLevel);
+                F.addFnAttr(OBFUSCATION_LEVEL_ATTRIBUTE, std::to_string(level));
+                numDefined++;
+                if (level == 0) continue;
+
+                numProtected++;
+                logs() << formatv("[*] Level {0} for function {1,-40}\n", level, F.getName());
+            }
+
+            logs() << formatv("[*] Protecting {0,10} of {1} functions\n", numProtected, numDefined);
+            return PreservedAnalyses::none();
+        }
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+
+using namespace llvm;
+
+#include "InlineHelpers.cc"
+#include "ObfuscationLevels.cc"
+#include "ControlFlowFlattening.cc"
+#include "SplitBasicBlocks.cc"
+#include "ArithmeticObf.cc"
+#include "StackEncoding.cc"
+#include "ConstantObf.cc"
+#include "IndirectCall.cc"
+#include "LazyDecrypt.cc"
+#include "IntegrityCheck.cc"
+
+static cl::opt<unsigned> DefaultLevel("ollvm-default-level", cl::desc("Obfuscation level of the functions no annotated function reaches (0-3)"), cl::init(0));
+
+namespace {
+    // The obfuscation passes, in the order they run, for the plugin at PipelineStart and for the tools.
+    // IntegrityCheck is not part of it: its hash records pin their functions, so it belongs after
+    // inlining and DCE. The plugin adds it at OptimizerLast, also for the modules the tools produce.
+    void addObfuscationPasses(ModulePassManager &MPM, OptimizationLevel Level) {
+        // Fold small helpers into their callers first, so only the post-inlining bodies are obfuscated
+        if (Level != OptimizationLevel::O0) {
+            MPM.addPass(InlineHelpers());
+            MPM.addPass(AlwaysInlinerPass());
+            MPM.addPass(StripHelperInline());
+        }
+
+        // Decide how much of the pipeline every function gets, from the annotated roots down
+        MPM.addPass(ObfuscationLevels(DefaultLevel));
+
+        // They will run in this order
+        MPM.addPass(ControlFlowFlattening());
+        MPM.addPass(SplitBasicBlocks());
+        MPM.addPass(ArithmeticObf());
+        MPM.addPass(StackEncoding());
+        MPM.addPass(ConstantObf());
+        MPM.addPass(IndirectCall());
+        MPM.addPass(LazyDecrypt());
+    }
+}
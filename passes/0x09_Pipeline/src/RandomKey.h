@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+namespace {
+    // 64 random bits for the key of a data encoding. rand() only gives 31 bits per call and is usually
+    // seeded from the time, so two calls leave bits 31 and 63 of the key always clear. The generator is
+    // per thread, since the compile server runs several modules at once.
+    uint64_t randomKey() {
+        thread_local std::mt19937_64 generator = [] {
+            std::random_device device;
+            std::seed_seq seeds{device(), device(), device(), device()};
+            return std::mt19937_64(seeds);
+        }();
+        return generator();
+    }
+}
@@ -2,6 +2,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
@@ -11,47 +12,100 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <cstdlib>
-#include <ctime>
+#include <vector>
+
+#include "Annotations.h"
+#include "Log.h"
+#include "ObfuscationInfo.h"
 
 #define SPLIT_CHANCE_PERCENT 50 // 50% chance that any given eligible block will be split
 
+#ifndef SPLIT_CHUNK_SIZE
+#define SPLIT_CHUNK_SIZE 16     // Instructions per chunk when a large block is cut into chunks
+#endif
+
+#ifndef SPLIT_CHUNK_THRESHOLD
+#define SPLIT_CHUNK_THRESHOLD 32 // Blocks with more instructions are cut into chunks, smaller ones are split at most once
+#endif
+
 using namespace llvm;
 
 namespace {
     struct SplitBasicBlocks : public PassInfoMixin<SplitBasicBlocks> {
+        // Cut BB every SPLIT_CHUNK_SIZE instructions. The split points are found in a single forward
+        // walk and then split back to front, so every split only moves the instructions of one chunk
+        // and the whole block is processed in linear time.
+        template <typename CallbackTy>
+        static void splitIntoChunks(BasicBlock *BB, CallbackTy &insertBogusBranch) {
+            std::vector<Instruction *> splitPoints;
+            unsigned count = 0;
+            Instruction *prev = nullptr;
+            for (Instruction &I : *BB) {
+                bool afterMustTail = prev && isa<CallInst>(prev) && cast<CallInst>(prev)->isMustTailCall();
+                if (++count > SPLIT_CHUNK_SIZE && !I.isTerminator() && !I.isEHPad() && !afterMustTail) {
+                    splitPoints.push_back(&I);
+                    count = 1;
+                }
+                prev = &I;
+            }
+
+            for (auto it = splitPoints.rbegin(); it != splitPoints.rend(); ++it) {
+                BasicBlock *successor = BB->splitBasicBlock(*it, BB->getName() + ".split");
+                insertBogusBranch(BB, successor);
+            }
+        }
+
         PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
-            errs() << formatv("\n[>] Split Basic Blocks Pass\n");
-            srand(time(NULL));
+            logs() << formatv("\n[>] Split Basic Blocks Pass\n");
 
             auto &CTX = M.getContext();
             IntegerType *int32Ty = IntegerType::getInt32Ty(CTX);
 
             FunctionCallee randFunc = M.getOrInsertFunction("rand", int32Ty);
-
-            auto containsPHI = [](const BasicBlock *BB) {
-                for (const Instruction &I : *BB) {
-                    if (isa<PHINode>(&I)) return true;
-                }
-                return false;
-            };
+            MDBuilder MDB(CTX);
+            auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            SmallPtrSet<Function *, 16> sensitive = getAnnotatedFunctions(M, OBFUSCATE_ANNOTATION);
 
             for (Function &F : M) {
                 if (F.isDeclaration()) continue;
 
-                F.addFnAttr(Attribute::NoInline);
+                // Only sensitive functions are kept out of line, everything else is left to the inliner.
+                if (sensitive.count(&F)) F.addFnAttr(Attribute::NoInline);
+                if (getObfuscationLevel(F) == 0) continue;
 
-                std::vector<BasicBlock *> worklist;
-                for (BasicBlock &BB : F) {
-                    if (BB.size() >= 3 && !containsPHI(&BB)) {
-                        worklist.push_back(&BB);                                                                    // Save to modify later
-                    }
-                }
+                std::vector<BasicBlock *> worklist = FAM.getResult<ObfuscationInfo>(F).splittableBlocks;          // Save to modify later
 
                 if (worklist.empty()) continue;
 
-                errs() << formatv("[*] Targeting {0,10} blocks in function {1,-20}", worklist.size(), F.getName());
+                logs() << formatv("[*] Targeting {0,10} blocks in function {1,-20}", worklist.size(), F.getName());
+
+                // Replace the fall-through of BB into successor with an opaque-looking branch over a dummy block.
+                auto insertBogusBranch = [&](BasicBlock *BB, BasicBlock *successor) {
+                    Instruction *oldTerminator = BB->getTerminator();
+
+                    BasicBlock *dummyBlock = BasicBlock::Create(CTX, BB->getName() + ".dummy", &F);               // Out of line, at the end of F
+                    IRBuilder<>(dummyBlock).CreateBr(successor)->setDebugLoc(oldTerminator->getDebugLoc());
+
+                    // The RNG picks the constant, the dummy block always sits on the edge that is never taken.
+                    // The weights keep BlockFrequencyInfo from halving the frequency of the code behind the split.
+                    bool condition = (rand() % 2 == 0);
+                    Value* fixedCond = condition ? ConstantInt::getTrue(CTX) : ConstantInt::getFalse(CTX);
+
+                    IRBuilder<> builder(oldTerminator);
+                    if (condition) {
+                        builder.CreateCondBr(fixedCond, successor, dummyBlock, MDB.createBranchWeights(1, 0));
+                    } else {
+                        builder.CreateCondBr(fixedCond, dummyBlock, successor, MDB.createBranchWeights(0, 1));
+                    }
+                    oldTerminator->eraseFromParent();
+                };
 
                 for (BasicBlock *BB : worklist) {
+                    if (BB->size() > SPLIT_CHUNK_THRESHOLD) {
+                        splitIntoChunks(BB, insertBogusBranch);
+                        continue;
+                    }
+
                     if ((rand() % 100) >= SPLIT_CHANCE_PERCENT) {
                         continue;
                     }
@@ -60,22 +114,13 @@ namespace {
                     auto splitIt = std::next(BB->begin(), splitIdx);
 
                     BasicBlock *successor = BB->splitBasicBlock(splitIt, BB->getName() + ".split");
-                    Instruction *oldTerminator = BB->getTerminator();
-
-                    BasicBlock *dummyBlock = BasicBlock::Create(CTX, BB->getName() + ".dummy", &F, successor);
-                    IRBuilder<>(dummyBlock).CreateBr(successor);
-
-                    bool condition = (rand() % 2 == 0);
-                    Value* fixedCond = condition ? ConstantInt::getTrue(CTX) : ConstantInt::getFalse(CTX);
-
-                    IRBuilder<> builder(oldTerminator);
-                    builder.CreateCondBr(fixedCond, successor, dummyBlock);
-                    oldTerminator->eraseFromParent();
+                    insertBogusBranch(BB, successor);
 
-                    //errs() << formatv("[REPLACED]: Block was slpitted\t");
+                    //logs() << formatv("[REPLACED]: Block was slpitted\t");
                 }
 
-                errs() << "[Done]\n";
+                FAM.invalidate(F, PreservedAnalyses::none());
+                logs() << "[Done]\n";
             }
             return PreservedAnalyses::none();
         }
@@ -0,0 +1,125 @@
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "Annotations.h"
+#include "DebugLocs.h"
+#include "Log.h"
+#include "RandomKey.h"
+
+#define STACK_MAX_PER_FUNCTION 8    // Locals encoded per function at the highest level, fewer at lower levels
+
+using namespace llvm;
+
+namespace {
+    // Keeps selected local variables encoded for their whole lifetime: every store writes `x ^ key`
+    // (or `x + key`) and every load undoes it right away. Only the values are encoded, never the
+    // pointer, so mem2reg still promotes the variable and the encoded value lives in a register.
+    struct StackEncoding : public PassInfoMixin<StackEncoding> {
+        // The integer locals mem2reg can promote: plain loads and stores of the allocated type only.
+        static bool isEligible(AllocaInst *AI) {
+            auto *Ty = dyn_cast<IntegerType>(AI->getAllocatedType());
+            if (!Ty || Ty->getBitWidth() < 8 || Ty->getBitWidth() > 64) return false;
+            return isAllocaPromotable(AI);
+        }
+
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+            logs() << formatv("\n[>] Stack Encoding Pass\n");
+
+            auto &CTX = M.getContext();
+            IntegerType *int64Ty = IntegerType::getInt64Ty(CTX);
+
+            uint64_t keyValue = randomKey();
+            GlobalVariable *key = nullptr;
+            bool changed = false;
+
+            for (Function &F : M) {
+                unsigned level = getObfuscationLevel(F);
+                if (F.isDeclaration() || level == 0) continue;
+
+                // The flattening state variable is created first, so it is always among the encoded ones.
+                unsigned budget = STACK_MAX_PER_FUNCTION * level / OBFUSCATION_LEVEL_MAX;
+                std::vector<AllocaInst *> worklist;
+                for (BasicBlock &BB : F) {
+                    for (Instruction &I : BB) {
+                        auto *AI = dyn_cast<AllocaInst>(&I);
+                        if (AI && worklist.size() < budget && isEligible(AI)) worklist.push_back(AI);   // Save to modify later
+                    }
+                }
+
+                if (worklist.empty()) continue;
+
+                logs() << formatv("[*] Encoding {0,10} locals in function {1,-20}", worklist.size(), F.getName());
+
+                if (!key) {
+                    key = new GlobalVariable(M, int64Ty, false, GlobalValue::PrivateLinkage,
+                                             ConstantInt::get(int64Ty, keyValue), "ollvm.sk");
+                }
+
+                // 1. Read the key twice, once for encoding and once for decoding. Both loads are volatile,
+                //    so the optimizer can not prove them equal and cancel an encode/decode pair once the
+                //    locals are in registers. These two are the only values the encoding keeps alive
+                //    across the function, however many locals are encoded.
+                IRBuilder<> keyBuilder(&*F.getEntryBlock().getFirstNonPHIOrDbgOrAlloca());
+                keyBuilder.SetCurrentDebugLocation(artificialLoc(F));
+                LoadInst *encodeKey = keyBuilder.CreateLoad(int64Ty, key, true, "sk.enc");
+                LoadInst *decodeKey = keyBuilder.CreateLoad(int64Ty, key, true, "sk.dec");
+
+                for (AllocaInst *AI : worklist) {
+                    IntegerType *Ty = cast<IntegerType>(AI->getAllocatedType());
+                    bool useXor = rand() % 2;
+
+                    std::vector<Instruction *> accesses;
+                    for (User *U : AI->users()) {
+                        if (isa<LoadInst>(U) || isa<StoreInst>(U)) accesses.push_back(cast<Instruction>(U));
+                    }
+
+                    // 2. Fuse a single ALU op into every access: encode right before each store and decode
+                    //    right after each load. The plain and the encoded value of a local are then never
+                    //    both live across other code. The truncation of the key is free (a subregister).
+                    for (Instruction *I : accesses) {
+                        if (auto *SI = dyn_cast<StoreInst>(I)) {
+                            IRBuilder<> builder(SI);
+                            Value *typedKey = builder.CreateTrunc(encodeKey, Ty, "sk.key");
+                            Value *value = SI->getValueOperand();
+                            SI->setOperand(0, useXor ? builder.CreateXor(value, typedKey, "sk")
+                                                     : builder.CreateAdd(value, typedKey, "sk"));
+                        } else {
+                            auto *LI = cast<LoadInst>(I);
+                            IRBuilder<> builder(LI->getNextNode());
+                            builder.SetCurrentDebugLocation(LI->getDebugLoc());
+                            Value *typedKey = builder.CreateTrunc(decodeKey, Ty, "sk.key");
+                            Value *decoded = useXor ? builder.CreateXor(LI, typedKey, "sk.val")
+                                                    : builder.CreateSub(LI, typedKey, "sk.val");
+                            LI->replaceUsesWithIf(decoded, [&](Use &U) { return U.getUser() != decoded; });
+                        }
+                    }
+
+                    // 3. The slot no longer holds the source value, so drop its debug declarations rather
+                    //    than let the debugger show the encoded one.
+                    for (DbgDeclareInst *DDI : findDbgDeclares(AI)) DDI->eraseFromParent();
+                    for (DbgVariableRecord *DVR : findDVRDeclares(AI)) DVR->eraseFromParent();
+                    at::deleteAssignmentMarkers(AI);
+                }
+
+                changed = true;
+                logs() << "[Done]\n";
+            }
+            return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+        }
+    };
+}
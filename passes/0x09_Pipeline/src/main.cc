@@ -1,11 +1,16 @@
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdlib>
+#include <ctime>
 
 using namespace llvm;
 
-#include "ControlFlowFlattening.cc"
-#include "SplitBasicBlocks.cc"
-#include "ArithmeticObf.cc"
+#include "Pipeline.h"
+
+// For the code generation step of the tools (ollvm-cc, streamed chunks), whose modules are already obfuscated
+static cl::opt<bool> IntegrityOnly("ollvm-integrity-only", cl::desc("Only add the integrity checks, at the end of the pipeline"));
 
 extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
     return {
@@ -13,12 +18,21 @@ extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
         .PluginName = "Pipeline",
         .PluginVersion = "v0.1",
         .RegisterPassBuilderCallbacks = [](PassBuilder &PB) {
+            srand(time(NULL));                                                          // Once, for every pass using rand()
+
+            PB.registerAnalysisRegistrationCallback(
+                [](FunctionAnalysisManager &FAM) {
+                    FAM.registerPass([] { return ObfuscationInfo(); });
+                });
             PB.registerPipelineStartEPCallback(
                 [](ModulePassManager &MPM, OptimizationLevel Level) {
-                    // They will run in this order
-                    MPM.addPass(ControlFlowFlattening());
-                    MPM.addPass(SplitBasicBlocks());
-                    MPM.addPass(ArithmeticObf());
+                    if (!IntegrityOnly) addObfuscationPasses(MPM, Level);
+                });
+
+            // Hash records pin their functions, so they are only added once inlining and DCE are done
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel Level, ThinOrFullLTOPhase Phase) {
+                    MPM.addPass(IntegrityCheck());
                 });
         }
     };
@@ -0,0 +1,109 @@
+#pragma once
+
+// ELF64 helpers shared by the post-link tools: map a linked binary read-write, find sections by name,
+// translate virtual addresses to file contents and look up function sizes in the symbol table.
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct function_symbol {
+    uint64_t vaddr;
+    uint64_t size;
+};
+
+static uint8_t *image;
+static size_t imageSize;
+static Elf64_Shdr *sections;
+static unsigned numSections;
+static const char *sectionNames;
+static struct function_symbol *functions;
+static size_t numFunctions;
+
+static int compare_symbols(const void *a, const void *b) {
+    uint64_t x = ((const struct function_symbol *)a)->vaddr, y = ((const struct function_symbol *)b)->vaddr;
+    return x < y ? -1 : x > y;
+}
+
+// Collect and sort the sized function symbols once, so every lookup is a binary search.
+static void load_functions(void) {
+    for (unsigned i = 0; i < numSections; ++i) {
+        if (sections[i].sh_type != SHT_SYMTAB) continue;
+
+        Elf64_Sym *symbols = (Elf64_Sym *)(image + sections[i].sh_offset);
+        size_t count = sections[i].sh_size / sizeof(Elf64_Sym);
+        functions = realloc(functions, (numFunctions + count) * sizeof(*functions));
+        for (size_t s = 0; s < count; ++s) {
+            if (ELF64_ST_TYPE(symbols[s].st_info) == STT_FUNC && symbols[s].st_size) {
+                functions[numFunctions++] = (struct function_symbol){ symbols[s].st_value, symbols[s].st_size };
+            }
+        }
+    }
+    qsort(functions, numFunctions, sizeof(*functions), compare_symbols);
+}
+
+// Map `path` and index it. Returns 0 on success, after printing the reason otherwise.
+static int elf_open(const char *path) {
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+
+    imageSize = st.st_size;
+    image = mmap(NULL, imageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)image;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
+        fprintf(stderr, "[!] %s is not an ELF64 file\n", path);
+        return -1;
+    }
+
+    sections = (Elf64_Shdr *)(image + ehdr->e_shoff);
+    numSections = ehdr->e_shnum;
+    sectionNames = (const char *)image + sections[ehdr->e_shstrndx].sh_offset;
+    load_functions();
+    return 0;
+}
+
+static void elf_close(void) {
+    msync(image, imageSize, MS_SYNC);
+    munmap(image, imageSize);
+}
+
+static Elf64_Shdr *elf_section(const char *name) {
+    for (unsigned i = 0; i < numSections; ++i) {
+        if (strcmp(sectionNames + sections[i].sh_name, name) == 0) return &sections[i];
+    }
+    return NULL;
+}
+
+// Map a virtual address to its bytes in the file, or NULL when it is not backed by file contents.
+static uint8_t *at_vaddr(uint64_t vaddr, uint64_t size) {
+    for (unsigned i = 0; i < numSections; ++i) {
+        Elf64_Shdr *sh = &sections[i];
+        if (sh->sh_type == SHT_NOBITS || !(sh->sh_flags & SHF_ALLOC)) continue;
+        if (vaddr >= sh->sh_addr && vaddr + size <= sh->sh_addr + sh->sh_size) {
+            return image + sh->sh_offset + (vaddr - sh->sh_addr);
+        }
+    }
+    return NULL;
+}
+
+static uint64_t function_size(uint64_t vaddr) {
+    struct function_symbol key = { vaddr, 0 };
+    struct function_symbol *found = bsearch(&key, functions, numFunctions, sizeof(*functions), compare_symbols);
+    return found ? found->size : 0;
+}
@@ -0,0 +1,53 @@
+// Post-link step for the IntegrityCheck pass: fills in the size and expected hash of every record in
+// the `ollvm_integrity` section of an ELF64 binary. Must run before the binary is stripped, since the
+// function sizes come from the symbol table.
+//
+//     integrity_patch <binary>
+
+#include "../runtime/integrity_hash.h"
+#include "elf_image.h"
+
+struct ollvm_region {
+    int64_t offset;
+    uint32_t size;
+    uint32_t flags;
+    uint64_t hash;
+};
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <binary>\n", argv[0]);
+        return 1;
+    }
+    if (elf_open(argv[1]) != 0) return 1;
+
+    unsigned patched = 0, missing = 0;
+    Elf64_Shdr *section = elf_section("ollvm_integrity");
+    if (section) {
+        struct ollvm_region *regions = (struct ollvm_region *)(image + section->sh_offset);
+        size_t count = section->sh_size / sizeof(struct ollvm_region);
+        for (size_t r = 0; r < count; ++r) {
+            uint64_t vaddr = section->sh_addr + r * sizeof(struct ollvm_region) + regions[r].offset;
+            uint64_t size = function_size(vaddr);
+            const uint8_t *code = size ? at_vaddr(vaddr, size) : NULL;
+            if (!code) {
+                missing++;
+                continue;
+            }
+
+            struct integrity_state state;
+            integrity_init(&state);
+            size_t blocks = size / INTEGRITY_BLOCK;
+            integrity_blocks_scalar(&state, code, blocks);
+
+            regions[r].size = (uint32_t)size;
+            regions[r].hash = integrity_final(&state, code + blocks * INTEGRITY_BLOCK, size % INTEGRITY_BLOCK, size);
+            regions[r].flags |= INTEGRITY_PATCHED;
+            patched++;
+        }
+    }
+
+    elf_close();
+    printf("[+] Patched %u integrity regions (%u without a symbol)\n", patched, missing);
+    return 0;
+}
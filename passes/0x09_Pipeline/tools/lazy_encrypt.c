@@ -0,0 +1,62 @@
+// Post-link step for the LazyDecrypt pass: encrypts the body of every function that has a record in the
+// `ollvm_lazy` section of an ELF64 binary, with a fresh random key per function. Must run before the
+// binary is stripped, since the function sizes come from the symbol table, and only once.
+//
+//     lazy_encrypt <binary>
+
+#include "../runtime/lazy_cipher.h"
+#include "elf_image.h"
+
+#include <sys/random.h>
+
+#define LAZY_ENCRYPTED 1
+
+struct ollvm_lazy {
+    int64_t body;
+    int64_t stub;
+    uint64_t key;
+    uint32_t size;
+    uint32_t flags;
+};
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <binary>\n", argv[0]);
+        return 1;
+    }
+    if (elf_open(argv[1]) != 0) return 1;
+
+    unsigned encrypted = 0, missing = 0;
+    Elf64_Shdr *section = elf_section("ollvm_lazy");
+    if (section) {
+        struct ollvm_lazy *records = (struct ollvm_lazy *)(image + section->sh_offset);
+        size_t count = section->sh_size / sizeof(struct ollvm_lazy);
+        for (size_t r = 0; r < count; ++r) {
+            if (records[r].flags & LAZY_ENCRYPTED) continue;                        // Already done by an earlier run
+
+            uint64_t vaddr = section->sh_addr + r * sizeof(struct ollvm_lazy) + records[r].body;
+            uint64_t size = function_size(vaddr);
+            uint8_t *code = size ? at_vaddr(vaddr, size) : NULL;
+            if (!code) {
+                missing++;
+                continue;
+            }
+
+            uint64_t key;
+            if (getrandom(&key, sizeof(key), 0) != sizeof(key)) {
+                perror("getrandom");
+                return 1;
+            }
+
+            lazy_crypt(code, size, key);
+            records[r].key = key;
+            records[r].size = (uint32_t)size;
+            records[r].flags |= LAZY_ENCRYPTED;
+            encrypted++;
+        }
+    }
+
+    elf_close();
+    printf("[+] Encrypted %u functions (%u without a symbol)\n", encrypted, missing);
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+#include "../../0x09_Pipeline/src/Pipeline.h"
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required);
+static cl::opt<std::string> OutputPrefix("o", cl::desc("Output prefix (writes <prefix>.bc and <prefix>.<n>.bc)"), cl::value_desc("prefix"), cl::Required);
+
+static ExitOnError ExitOnErr("ollvm-stream: ");
+
+namespace {
+    // Give every local symbol a hidden external linkage, so a function moved into its own
+    // module can still reference (and be referenced by) the rest of the program.
+    void externalizeLocals(Module &M) {
+        auto externalize = [](GlobalValue &GV) {
+            if (!GV.hasLocalLinkage()) return;
+            if (!GV.hasName()) GV.setName("ollvm.anon");
+            GV.setLinkage(GlobalValue::ExternalLinkage);
+            GV.setVisibility(GlobalValue::HiddenVisibility);
+        };
+
+        for (Function &F : M) externalize(F);
+        for (GlobalVariable &GV : M.globals()) externalize(GV);
+        for (GlobalAlias &GA : M.aliases()) externalize(GA);
+        for (GlobalIFunc &GI : M.ifuncs()) externalize(GI);
+    }
+
+    // Declare `GV` in `chunk`. Aliases and ifuncs become plain declarations of their value type.
+    GlobalValue *declareIn(Module &chunk, GlobalValue *GV) {
+        if (auto *FTy = dyn_cast<FunctionType>(GV->getValueType())) {
+            Function *decl = Function::Create(FTy, GlobalValue::ExternalLinkage, GV->getAddressSpace(), GV->getName(), &chunk);
+            if (auto *F = dyn_cast<Function>(GV)) decl->setAttributes(F->getAttributes());
+            decl->setVisibility(GV->getVisibility());
+            return decl;
+        }
+
+        auto *GVar = dyn_cast<GlobalVariable>(GV);
+        auto *decl = new GlobalVariable(chunk, GV->getValueType(), GVar && GVar->isConstant(), GlobalValue::ExternalLinkage,
+                                        nullptr, GV->getName(), nullptr, GV->getThreadLocalMode(), GV->getAddressSpace());
+        decl->setVisibility(GV->getVisibility());
+        return decl;
+    }
+
+    // Copy the `llvm.global.annotations` entries of `F` into `chunk`, so the passes driven by
+    // annotations (`obfuscate`) see the same functions as in the plugin. The strings are copied
+    // as private constants, the optional argument structs are dropped.
+    void copyAnnotations(Function &F, Function *newF, Module &chunk) {
+        GlobalVariable *annotations = F.getParent()->getNamedGlobal("llvm.global.annotations");
+        if (!annotations || !annotations->hasInitializer()) return;
+
+        auto *entries = dyn_cast<ConstantArray>(annotations->getInitializer());
+        if (!entries) return;
+
+        auto copyString = [&](Constant *C) -> Constant * {
+            auto *str = dyn_cast<GlobalVariable>(C->stripPointerCasts());
+            if (!str || !str->hasInitializer()) return Constant::getNullValue(C->getType());
+            return new GlobalVariable(chunk, str->getValueType(), true, GlobalValue::PrivateLinkage, str->getInitializer(), ".str");
+        };
+
+        std::vector<Constant *> copied;
+        for (Value *entry : entries->operands()) {
+            auto *fields = dyn_cast<ConstantStruct>(entry);
+            if (!fields || fields->getNumOperands() < 4 || fields->getOperand(0)->stripPointerCasts() != &F) continue;
+
+            std::vector<Constant *> newFields = {newF, copyString(fields->getOperand(1)), copyString(fields->getOperand(2)), fields->getOperand(3)};
+            for (unsigned i = 4; i < fields->getNumOperands(); ++i) newFields.push_back(Constant::getNullValue(fields->getOperand(i)->getType()));
+            copied.push_back(ConstantStruct::get(fields->getType(), newFields));
+        }
+        if (copied.empty()) return;
+
+        ArrayType *arrayTy = ArrayType::get(entries->getType()->getElementType(), copied.size());
+        auto *chunkAnnotations = new GlobalVariable(chunk, arrayTy, false, GlobalValue::AppendingLinkage,
+                                                    ConstantArray::get(arrayTy, copied), "llvm.global.annotations");
+        chunkAnnotations->setSection("llvm.metadata");
+    }
+
+    // Aliases of `F` (e.g. the C1/C2 constructor aliases) must stay next to their target's definition.
+    std::vector<GlobalAlias *> aliasesOf(Function &F) {
+        std::vector<GlobalAlias *> aliases;
+        for (GlobalAlias &GA : F.getParent()->aliases()) {
+            if (GA.getAliaseeObject() == &F) aliases.push_back(&GA);
+        }
+        return aliases;
+    }
+
+    // Move the body of `F` into a fresh module that only declares what the body references.
+    // Returns nullptr for functions that can not live on their own (block addresses).
+    std::unique_ptr<Module> extractFunction(Function &F) {
+        for (BasicBlock &BB : F) {
+            if (BB.hasAddressTaken()) return nullptr;
+        }
+
+        Module &M = *F.getParent();
+        auto chunk = std::make_unique<Module>(F.getName(), M.getContext());
+        chunk->setDataLayout(M.getDataLayout());
+        chunk->setTargetTriple(M.getTargetTriple());
+        if (NamedMDNode *flags = M.getModuleFlagsMetadata()) {
+            NamedMDNode *chunkFlags = chunk->getOrInsertModuleFlagsMetadata();
+            for (MDNode *flag : flags->operands()) chunkFlags->addOperand(flag);
+        }
+
+        Function *newF = Function::Create(F.getFunctionType(), F.getLinkage(), F.getAddressSpace(), F.getName(), chunk.get());
+        newF->copyAttributesFrom(&F);
+        if (const Comdat *C = F.getComdat()) {
+            Comdat *chunkComdat = chunk->getOrInsertComdat(C->getName());
+            chunkComdat->setSelectionKind(C->getSelectionKind());
+            newF->setComdat(chunkComdat);
+        }
+
+        ValueToValueMapTy VMap;
+        VMap[&F] = newF;
+
+        // The aliases of F move along with it. They are mapped before the body is walked, so a
+        // reference to one of them is not turned into a declaration.
+        std::vector<GlobalAlias *> aliases = aliasesOf(F);
+        for (GlobalAlias *GA : aliases) {
+            GlobalAlias *newGA = GlobalAlias::create(GA->getValueType(), GA->getAddressSpace(), GA->getLinkage(), GA->getName(), newF, chunk.get());
+            newGA->copyAttributesFrom(GA);
+            VMap[GA] = newGA;
+        }
+        for (GlobalAlias *GA : aliases) {
+            cast<GlobalAlias>(VMap[GA])->setAliasee(MapValue(GA->getAliasee(), VMap));
+        }
+        auto newArg = newF->arg_begin();
+        for (Argument &arg : F.args()) {
+            newArg->setName(arg.getName());
+            VMap[&arg] = &*newArg++;
+        }
+
+        // Walk every constant the body touches and declare the globals behind them.
+        std::vector<Constant *> worklist;
+        SmallPtrSet<Constant *, 32> visited;
+        if (F.hasPersonalityFn()) worklist.push_back(F.getPersonalityFn());
+        if (F.hasPrefixData()) worklist.push_back(F.getPrefixData());
+        if (F.hasPrologueData()) worklist.push_back(F.getPrologueData());
+        for (BasicBlock &BB : F) {
+            for (Instruction &I : BB) {
+                for (Value *op : I.operands()) {
+                    if (auto *C = dyn_cast<Constant>(op)) worklist.push_back(C);
+                }
+            }
+        }
+
+        while (!worklist.empty()) {
+            Constant *C = worklist.back();
+            worklist.pop_back();
+            if (!visited.insert(C).second) continue;
+
+            if (auto *BA = dyn_cast<BlockAddress>(C)) {
+                if (BA->getFunction() != &F) return nullptr;
+                continue;
+            }
+            if (auto *GV = dyn_cast<GlobalValue>(C)) {
+                if (!VMap.count(GV)) VMap[GV] = declareIn(*chunk, GV);
+                continue;
+            }
+            for (Value *op : C->operands()) {
+                worklist.push_back(cast<Constant>(op));
+            }
+        }
+
+        SmallVector<ReturnInst *, 8> returns;
+        CloneFunctionInto(newF, &F, VMap, CloneFunctionChangeType::DifferentModule, returns);
+        copyAnnotations(F, newF, *chunk);
+
+        NamedMDNode *CUs = chunk->getNamedMetadata("llvm.dbg.cu");                         // Created even without debug info
+        if (CUs && CUs->getNumOperands() == 0) chunk->eraseNamedMetadata(CUs);
+        return chunk;
+    }
+
+    void writeBitcode(const Module &M, const std::string &path) {
+        std::error_code EC;
+        raw_fd_ostream OS(path, EC, sys::fs::OF_None);
+        if (EC) ExitOnErr(errorCodeToError(EC));
+        WriteBitcodeToFile(M, OS);
+    }
+
+    void obfuscate(Module &chunk) {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB;
+        FAM.registerPass([] { return ObfuscationInfo(); });
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        // Same passes as the Pipeline plugin. A chunk holds a single definition, so there is nothing to inline,
+        // and IntegrityCheck is added by the plugin when the chunks are compiled.
+        ModulePassManager MPM;
+        addObfuscationPasses(MPM, OptimizationLevel::O0);
+        MPM.run(chunk, MAM);
+    }
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "Streaming OLLVM obfuscation driver\n");
+    srand(time(NULL));
+
+    LLVMContext CTX;
+    std::unique_ptr<MemoryBuffer> buffer = ExitOnErr(errorOrToExpected(MemoryBuffer::getFileOrSTDIN(InputFilename)));
+    std::unique_ptr<Module> M = ExitOnErr(getLazyBitcodeModule(buffer->getMemBufferRef(), CTX));
+
+    externalizeLocals(*M);
+
+    // Only one function body is materialized at any time: it is loaded, moved into its own
+    // module, obfuscated, written out and then dropped from the lazy module again.
+    unsigned chunkId = 0;
+    for (Function &F : *M) {
+        if (F.isDeclaration()) continue;
+        ExitOnErr(F.materialize());
+
+        if (F.hasAvailableExternallyLinkage()) {
+            F.deleteBody();
+            continue;
+        }
+
+        std::unique_ptr<Module> chunk = extractFunction(F);
+        if (!chunk) {
+            errs() << formatv("[*] Keeping function {0,-25} (block addresses)\n", F.getName());
+            continue;
+        }
+
+        errs() << formatv("\n[>] Streaming function {0} -> chunk {1}\n", F.getName(), ++chunkId);
+        obfuscate(*chunk);
+        if (verifyModule(*chunk, &errs())) {
+            ExitOnErr(createStringError(inconvertibleErrorCode(), "broken module after obfuscating " + F.getName()));
+        }
+        writeBitcode(*chunk, formatv("{0}.{1}.bc", OutputPrefix, chunkId).str());
+
+        // The aliases of F now live in its chunk, only their declarations stay behind.
+        for (GlobalAlias *GA : aliasesOf(F)) {
+            GlobalValue *decl = declareIn(*M, GA);
+            decl->takeName(GA);
+            decl->setDSOLocal(GA->isDSOLocal());
+            GA->replaceAllUsesWith(decl);
+            GA->eraseFromParent();
+        }
+
+        F.deleteBody();
+        F.setComdat(nullptr);
+        F.clearMetadata();
+    }
+
+    // What remains are the global variables, the aliases of kept functions and declarations of the streamed ones.
+    ExitOnErr(M->materializeAll());
+    if (verifyModule(*M, &errs())) {
+        ExitOnErr(createStringError(inconvertibleErrorCode(), "broken module after streaming"));
+    }
+    writeBitcode(*M, OutputPrefix + ".bc");
+
+    errs() << formatv("\n[+] Wrote {0} function chunks and {1}.bc\n", chunkId, OutputPrefix);
+    return 0;
+}
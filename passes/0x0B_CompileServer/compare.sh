@@ -0,0 +1,46 @@
+#!/bin/bash
+# Wall-clock time to compile the same sources through the Pipeline plugin and through ollvm-cc.
+#
+#     passes/0x0B_CompileServer/compare.sh [-O<level>] [-j <jobs>] <sources...>
+#
+# Needs bin/ollvm.so, bin/ollvm-client and an `ollvm-server` listening on $OLLVM_SOCKET. Both sides
+# run the same number of compiles in parallel and write their objects to a scratch directory.
+
+CLANG=${CLANG:-clang}
+HERE=$(dirname "$0")
+
+level=-O2
+jobs=1
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -O*) level=$1 ;;
+        -j) jobs=$2; shift ;;
+        *) break ;;
+    esac
+    shift
+done
+[ $# -gt 0 ] || { echo "Usage: $0 [-O<level>] [-j <jobs>] <sources...>" >&2; exit 1; }
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+sources=("$@")
+
+# Compile every source with the given command, `jobs` at a time, and print the milliseconds taken
+measure() {
+    local start=$(date +%s%N) running=0
+    for source in "${sources[@]}"; do
+        { "$@" "$level" -c "$source" -o "$tmp/$(basename "$source").o" 2>/dev/null || echo "failed: $source" >&2; } &
+        if [ $((++running)) -ge "$jobs" ]; then
+            wait -n
+            running=$((running - 1))
+        fi
+    done
+    wait
+    echo $((($(date +%s%N) - start) / 1000000))
+}
+
+plugin=$(measure "$CLANG" -fpass-plugin=bin/ollvm.so)
+server=$(measure "$HERE/ollvm-cc")
+
+printf "%-10s %8s ms\n" plugin "$plugin" ollvm-cc "$server"
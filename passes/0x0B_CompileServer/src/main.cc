@@ -0,0 +1,198 @@
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+#include "../../0x09_Pipeline/src/Pipeline.h"
+
+#include "../tools/protocol.h"
+
+#define SERVER_BACKLOG 128                      // Pending connections before clients are refused
+
+static cl::opt<std::string> SocketPath("socket", cl::desc("Unix domain socket of the server"), cl::value_desc("path"), cl::init("/tmp/ollvm.sock"));
+static cl::opt<unsigned> Jobs("j", cl::desc("Worker threads (default: one per core)"), cl::init(0));
+
+static ExitOnError ExitOnErr("ollvm-server: ");
+
+namespace {
+    std::mutex logMutex;                        // Serializes the job logs on stderr
+
+    bool readAll(int fd, void *data, size_t size) {
+        auto *bytes = static_cast<char *>(data);
+        while (size) {
+            ssize_t n = read(fd, bytes, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool writeAll(int fd, const void *data, size_t size) {
+        auto *bytes = static_cast<const char *>(data);
+        while (size) {
+            ssize_t n = write(fd, bytes, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool sendMessage(int fd, uint32_t value, StringRef payload) {
+        ollvm_message header = {OLLVM_MESSAGE_MAGIC, value, payload.size()};
+        return writeAll(fd, &header, sizeof(header)) && writeAll(fd, payload.data(), payload.size());
+    }
+
+    bool receiveMessage(int fd, uint32_t &value, std::string &payload) {
+        ollvm_message header;
+        if (!readAll(fd, &header, sizeof(header)) || header.magic != OLLVM_MESSAGE_MAGIC) return false;
+        if (header.size > OLLVM_MAX_MESSAGE) return false;
+
+        value = header.value;
+        payload.resize(header.size);
+        return readAll(fd, payload.data(), payload.size());
+    }
+
+    int listenOn(const std::string &path) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            ExitOnErr(createStringError(inconvertibleErrorCode(), "socket path too long: " + path));
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) ExitOnErr(errorCodeToError(std::error_code(errno, std::generic_category())));
+
+        unlink(path.c_str());                                                       // Left behind by a previous server
+        int status = bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        if (status == 0) status = listen(fd, SERVER_BACKLOG);
+        if (status < 0) {
+            ExitOnErr(createStringError(std::error_code(errno, std::generic_category()), "%s: %s", path.c_str(),
+                                        std::strerror(errno)));
+        }
+        return fd;
+    }
+
+    // Same passes, in the same order, as the Pipeline plugin. IntegrityCheck is left to the plugin in the
+    // code generation step, after the optimizer.
+    void obfuscate(Module &M, unsigned level) {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB;
+        FAM.registerPass([] { return ObfuscationInfo(); });
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        const OptimizationLevel levels[] = {OptimizationLevel::O0, OptimizationLevel::O1, OptimizationLevel::O2, OptimizationLevel::O3};
+
+        ModulePassManager MPM;
+        addObfuscationPasses(MPM, levels[std::min(level, 3u)]);
+        MPM.run(M, MAM);
+    }
+
+    // One request per connection. Every job gets its own LLVMContext, so workers never share IR, and
+    // its own log, printed in one piece once the job is done.
+    void handleClient(int fd) {
+        uint32_t level;
+        std::string bitcode;
+        if (!receiveMessage(fd, level, bitcode)) {
+            close(fd);
+            return;
+        }
+
+        std::string log;
+        raw_string_ostream logStream(log);
+        passLog = &logStream;
+        auto flushLog = make_scope_exit([&] {
+            passLog = nullptr;
+            std::lock_guard<std::mutex> lock(logMutex);
+            errs() << logStream.str();
+        });
+
+        LLVMContext CTX;
+        Expected<std::unique_ptr<Module>> M = parseBitcodeFile(MemoryBufferRef(bitcode, "<client>"), CTX);
+        if (!M) {
+            sendMessage(fd, 1, toString(M.takeError()));
+            close(fd);
+            return;
+        }
+
+        obfuscate(**M, level);
+
+        std::string error;
+        raw_string_ostream errorStream(error);
+        if (verifyModule(**M, &errorStream)) {
+            sendMessage(fd, 1, "broken module after obfuscation\n" + errorStream.str());
+            close(fd);
+            return;
+        }
+
+        SmallVector<char, 0> output;
+        BitcodeWriter writer(output);
+        writer.writeModule(**M);
+        writer.writeSymtab();
+        writer.writeStrtab();
+
+        sendMessage(fd, 0, StringRef(output.data(), output.size()));
+        close(fd);
+    }
+
+    int runServer() {
+        signal(SIGPIPE, SIG_IGN);                                                   // Clients may go away mid-reply
+        srand(time(NULL));                                                          // Once, for every job
+
+        int listener = listenOn(SocketPath);
+        DefaultThreadPool pool(Jobs ? hardware_concurrency(Jobs) : hardware_concurrency());
+        errs() << formatv("[+] Listening on {0} with {1} workers\n", SocketPath, pool.getMaxConcurrency());
+
+        for (;;) {
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                ExitOnErr(errorCodeToError(std::error_code(errno, std::generic_category())));
+            }
+            pool.async([client] { handleClient(client); });
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "OLLVM obfuscation compile server\n");
+    return runServer();
+}
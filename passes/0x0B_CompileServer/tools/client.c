@@ -0,0 +1,149 @@
+// Client for `ollvm-server`: sends one bitcode file to the server and writes the obfuscated reply.
+// It only moves bytes, so unlike the server it does not link LLVM and starts as fast as `cat`.
+//
+//     client [-socket <path>] [-O<level>] <input bitcode> [-o <output bitcode>]
+//
+// `-` (the default for both) is stdin / stdout.
+
+#include "protocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int read_all(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size) {
+        ssize_t n = read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        bytes += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size) {
+        ssize_t n = write(fd, bytes, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        bytes += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Read a whole file (or stdin) into memory, refusing anything the server would refuse too.
+static char *read_input(const char *path, size_t *size) {
+    int fd = strcmp(path, "-") ? open(path, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    if (fd < 0) {
+        fprintf(stderr, "client: %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    size_t capacity = 1 << 16, length = 0;
+    char *data = malloc(capacity);
+    for (;;) {
+        if (length == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+        ssize_t n = read(fd, data + length, capacity - length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            fprintf(stderr, "client: %s: %s\n", path, strerror(errno));
+            free(data);
+            return NULL;
+        }
+        if (n == 0) break;
+        length += n;
+        if (length > OLLVM_MAX_MESSAGE) {
+            fprintf(stderr, "client: %s: larger than %u bytes\n", path, OLLVM_MAX_MESSAGE);
+            free(data);
+            return NULL;
+        }
+    }
+
+    if (fd != STDIN_FILENO) close(fd);
+    *size = length;
+    return data;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "client: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "client: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    const char *socket_path = "/tmp/ollvm.sock", *input = "-", *output = "-";
+    unsigned level = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-socket") && i + 1 < argc) socket_path = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc) output = argv[++i];
+        else if (!strncmp(argv[i], "-O", 2)) level = atoi(argv[i] + 2);
+        else if (argv[i][0] != '-' || !strcmp(argv[i], "-")) input = argv[i];
+        else {
+            fprintf(stderr, "Usage: %s [-socket <path>] [-O<level>] <input bitcode> [-o <output bitcode>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t size;
+    char *bitcode = read_input(input, &size);
+    if (!bitcode) return 1;
+
+    int fd = connect_to(socket_path);
+    if (fd < 0) return 1;
+
+    // 1. Send the request
+    struct ollvm_message request = {OLLVM_MESSAGE_MAGIC, level, size};
+    struct ollvm_message reply;
+    if (write_all(fd, &request, sizeof(request)) || write_all(fd, bitcode, size) ||
+        read_all(fd, &reply, sizeof(reply)) || reply.magic != OLLVM_MESSAGE_MAGIC || reply.size > OLLVM_MAX_MESSAGE) {
+        fprintf(stderr, "client: lost connection to %s\n", socket_path);
+        return 1;
+    }
+    free(bitcode);
+
+    // 2. Receive the obfuscated module, or the error
+    char *payload = malloc(reply.size ? reply.size : 1);
+    if (read_all(fd, payload, reply.size)) {
+        fprintf(stderr, "client: lost connection to %s\n", socket_path);
+        return 1;
+    }
+    close(fd);
+
+    if (reply.value != 0) {
+        fprintf(stderr, "client: %.*s\n", (int)reply.size, payload);
+        return 1;
+    }
+
+    int out = strcmp(output, "-") ? open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : STDOUT_FILENO;
+    if (out < 0 || write_all(out, payload, reply.size)) {
+        fprintf(stderr, "client: %s: %s\n", output, strerror(errno));
+        return 1;
+    }
+    if (out != STDOUT_FILENO) close(out);
+    free(payload);
+    return 0;
+}
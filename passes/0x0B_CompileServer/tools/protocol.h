@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+// Wire format shared by the server (src/main.cc) and the client (tools/client.c).
+//
+// Every message is a fixed header followed by `size` bytes of payload. Requests carry the bitcode to
+// obfuscate, replies carry the obfuscated bitcode or, on failure, the error text.
+
+#define OLLVM_MESSAGE_MAGIC 0x4f4c564du     // "OLVM"
+#define OLLVM_MAX_MESSAGE (256u << 20)      // Largest payload accepted in either direction
+
+struct ollvm_message {
+    uint32_t magic;
+    uint32_t value;                         // Request: optimization level. Reply: 0 on success.
+    uint64_t size;
+};
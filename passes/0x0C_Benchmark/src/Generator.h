@@ -0,0 +1,198 @@
+#pragma once
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FormatVariadic.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#define GEN_LOOP_DEPTH 8                // Depth of every loop nest in the "loops" shape
+
+using namespace llvm;
+
+namespace {
+    // Emits modules with a single function `i32 @<shape>_<size>(i32)` of a controllable shape. Locals
+    // live in allocas and are reloaded in every block, like clang's output before mem2reg, since that
+    // is what the pipeline sees at PipelineStart. Only "phis" is in SSA form.
+    class Generator {
+    public:
+        static constexpr const char *Shapes[] = {"blocks", "loops", "straight", "switch", "phis"};
+
+        Generator(LLVMContext &CTX) : CTX(CTX), builder(CTX), int32Ty(IntegerType::getInt32Ty(CTX)) {}
+
+        static bool isShape(StringRef shape) {
+            return llvm::is_contained(Shapes, shape);
+        }
+
+        // `size` is the number of blocks, except for "straight" (instructions) and "switch" (cases).
+        std::unique_ptr<Module> generate(StringRef shape, unsigned size) {
+            assert(isShape(shape) && "unknown shape");
+            auto M = std::make_unique<Module>(formatv("{0}_{1}", shape, size).str(), CTX);
+            FunctionType *FTy = FunctionType::get(int32Ty, {int32Ty}, false);
+            F = Function::Create(FTy, GlobalValue::ExternalLinkage, M->getName(), M.get());
+
+            BasicBlock *entry = BasicBlock::Create(CTX, "entry", F);
+            builder.SetInsertPoint(entry);
+            xAddr = builder.CreateAlloca(int32Ty, nullptr, "x.addr");
+            acc = builder.CreateAlloca(int32Ty, nullptr, "acc");
+            builder.CreateStore(F->getArg(0), xAddr);
+            builder.CreateStore(builder.getInt32(0), acc);
+
+            exit = BasicBlock::Create(CTX, "exit");
+            if (shape == "blocks") genBlocks(size);
+            else if (shape == "loops") genLoops(size);
+            else if (shape == "straight") genStraight(size);
+            else if (shape == "switch") genSwitch(size);
+            else genPhis(size);
+
+            exit->insertInto(F);
+            builder.SetInsertPoint(exit);
+            builder.CreateRet(builder.CreateLoad(int32Ty, acc));
+            return M;
+        }
+
+    private:
+        LLVMContext &CTX;
+        IRBuilder<> builder;
+        IntegerType *int32Ty;
+        Function *F = nullptr;
+        BasicBlock *exit = nullptr;
+        Value *xAddr = nullptr;
+        Value *acc = nullptr;
+
+        // acc = acc <op> value, cycling through the operators ArithmeticObf targets
+        void updateAcc(Value *value, unsigned k) {
+            Value *old = builder.CreateLoad(int32Ty, acc);
+            Value *updated;
+            switch (k % 5) {
+                case 0: updated = builder.CreateAdd(old, value); break;
+                case 1: updated = builder.CreateXor(old, value); break;
+                case 2: updated = builder.CreateSub(old, value); break;
+                case 3: updated = builder.CreateOr(old, value); break;
+                default: updated = builder.CreateAnd(old, value); break;
+            }
+            builder.CreateStore(updated, acc);
+        }
+
+        // A chain of blocks, each branching forward to one of the next two.
+        void genBlocks(unsigned size) {
+            std::vector<BasicBlock *> blocks;
+            for (unsigned k = 0; k < size; ++k) blocks.push_back(BasicBlock::Create(CTX, "block", F));
+            blocks.push_back(exit);
+            builder.CreateBr(blocks[0]);
+
+            for (unsigned k = 0; k < size; ++k) {
+                builder.SetInsertPoint(blocks[k]);
+                updateAcc(builder.getInt32(k), k);
+                Value *cond = builder.CreateICmpSLT(builder.CreateLoad(int32Ty, acc), builder.CreateLoad(int32Ty, xAddr));
+                builder.CreateCondBr(cond, blocks[k + 1], blocks[std::min(k + 2, size)]);
+            }
+        }
+
+        // Consecutive loop nests of GEN_LOOP_DEPTH levels, 4 blocks per level.
+        void genLoops(unsigned size) {
+            IRBuilder<> allocas(&F->getEntryBlock(), F->getEntryBlock().begin());
+            unsigned nests = std::max(1u, size / (4 * GEN_LOOP_DEPTH));
+
+            for (unsigned n = 0; n < nests; ++n) {
+                std::vector<Value *> counters;
+                std::vector<BasicBlock *> headers, latches, exits;
+                for (unsigned d = 0; d < GEN_LOOP_DEPTH; ++d) {
+                    Value *counter = allocas.CreateAlloca(int32Ty, nullptr, "i");
+                    BasicBlock *header = BasicBlock::Create(CTX, "loop.header", F);
+                    BasicBlock *body = BasicBlock::Create(CTX, "loop.body", F);
+                    builder.CreateStore(builder.getInt32(0), counter);
+                    builder.CreateBr(header);
+
+                    builder.SetInsertPoint(header);
+                    Value *cond = builder.CreateICmpSLT(builder.CreateLoad(int32Ty, counter), builder.CreateLoad(int32Ty, xAddr));
+                    exits.push_back(BasicBlock::Create(CTX, "loop.exit"));
+                    builder.CreateCondBr(cond, body, exits.back());
+                    builder.SetInsertPoint(body);
+
+                    counters.push_back(counter);
+                    headers.push_back(header);
+                    latches.push_back(BasicBlock::Create(CTX, "loop.latch"));
+                }
+
+                updateAcc(builder.CreateLoad(int32Ty, counters.back()), n);
+
+                // Close the nest from the innermost loop outwards
+                for (unsigned d = GEN_LOOP_DEPTH; d-- > 0;) {
+                    builder.CreateBr(latches[d]);
+                    latches[d]->insertInto(F);
+                    builder.SetInsertPoint(latches[d]);
+                    builder.CreateStore(builder.CreateAdd(builder.CreateLoad(int32Ty, counters[d]), builder.getInt32(1)), counters[d]);
+                    builder.CreateBr(headers[d]);
+
+                    exits[d]->insertInto(F);
+                    builder.SetInsertPoint(exits[d]);
+                }
+            }
+            builder.CreateBr(exit);
+        }
+
+        // A single block with `size` arithmetic instructions.
+        void genStraight(unsigned size) {
+            Value *x = builder.CreateLoad(int32Ty, xAddr);
+            Value *value = x;
+            for (unsigned k = 0; k < size; ++k) {
+                switch (k % 5) {
+                    case 0: value = builder.CreateAdd(value, x); break;
+                    case 1: value = builder.CreateXor(value, builder.getInt32(k)); break;
+                    case 2: value = builder.CreateSub(value, x); break;
+                    case 3: value = builder.CreateOr(value, builder.getInt32(k)); break;
+                    default: value = builder.CreateAnd(value, x); break;
+                }
+            }
+            builder.CreateStore(value, acc);
+            builder.CreateBr(exit);
+        }
+
+        // One switch on the argument with `size` cases.
+        void genSwitch(unsigned size) {
+            SwitchInst *sw = builder.CreateSwitch(builder.CreateLoad(int32Ty, xAddr), exit, size);
+            for (unsigned k = 0; k < size; ++k) {
+                BasicBlock *target = BasicBlock::Create(CTX, "case", F);
+                sw->addCase(builder.getInt32(k), target);
+                builder.SetInsertPoint(target);
+                updateAcc(builder.getInt32(k * 7), k);
+                builder.CreateBr(exit);
+            }
+        }
+
+        // Diamonds in SSA form: every join merges the value of both sides with a PHI node.
+        void genPhis(unsigned size) {
+            Value *value = builder.CreateLoad(int32Ty, xAddr);
+            unsigned diamonds = std::max(1u, size / 3);
+            for (unsigned k = 0; k < diamonds; ++k) {
+                BasicBlock *left = BasicBlock::Create(CTX, "left", F);
+                BasicBlock *right = BasicBlock::Create(CTX, "right", F);
+                BasicBlock *join = BasicBlock::Create(CTX, "join", F);
+                builder.CreateCondBr(builder.CreateICmpSLT(value, builder.getInt32(k)), left, right);
+
+                builder.SetInsertPoint(left);
+                Value *l = builder.CreateAdd(value, builder.getInt32(k));
+                builder.CreateBr(join);
+                builder.SetInsertPoint(right);
+                Value *r = builder.CreateXor(value, builder.getInt32(k));
+                builder.CreateBr(join);
+
+                builder.SetInsertPoint(join);
+                PHINode *phi = builder.CreatePHI(int32Ty, 2);
+                phi->addIncoming(l, left);
+                phi->addIncoming(r, right);
+                value = phi;
+            }
+            builder.CreateStore(value, acc);
+            builder.CreateBr(exit);
+        }
+    };
+}
@@ -0,0 +1,228 @@
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace llvm;
+
+#include "../../0x09_Pipeline/src/Pipeline.h"
+
+#include "Generator.h"
+
+#define BENCH_SUPERLINEAR 1.5           // Growth exponent between two sizes that is reported as superlinear
+#define BENCH_EXIT_BROKEN 2             // Child exit status: the module failed verification
+#define BENCH_EXIT_MEMORY 3             // Child exit status: an allocation failed under -memory-limit
+
+static cl::list<std::string> ShapeList("shapes", cl::desc("Shapes to generate (blocks, loops, straight, switch, phis)"), cl::CommaSeparated);
+static cl::list<unsigned> SizeList("sizes", cl::desc("Sizes to generate"), cl::CommaSeparated);
+static cl::opt<unsigned> Timeout("timeout", cl::desc("Seconds before a single configuration is given up"), cl::init(120));
+static cl::opt<unsigned> MemoryLimit("memory-limit", cl::desc("Address space limit of a single configuration, in MiB"), cl::init(8192));
+static cl::opt<unsigned> Level("level", cl::desc("Obfuscation level of the generated functions (1-3)"), cl::init(1));
+static cl::list<std::string> PassList("passes", cl::desc("Only run these passes (default: all)"), cl::CommaSeparated);
+static cl::opt<std::string> EmitFilename("emit", cl::desc("Only write the module of the first shape and size to this file"), cl::value_desc("file"));
+
+static ExitOnError ExitOnErr("ollvm-bench: ");
+
+namespace {
+    struct PassResult {
+        char pass[32];
+        unsigned instructions;          // Size of the module after the pass
+        double seconds;
+        long peakRssKb;                 // Peak of the whole process so far
+    };
+
+    // "(anonymous namespace)::ControlFlowFlattening" -> "ControlFlowFlattening"
+    StringRef shortName(StringRef pass) {
+        size_t scope = pass.rfind("::");
+        return scope == StringRef::npos ? pass : pass.drop_front(scope + 2);
+    }
+
+    unsigned countInstructions(Module &M) {
+        unsigned count = 0;
+        for (Function &F : M) count += F.getInstructionCount();
+        return count;
+    }
+
+    // Runs in a forked child, so every configuration starts from a fresh heap and its peak RSS is its own.
+    // Results go back through `fd` as they are measured, so a timeout still reports the passes that finished.
+    void runConfiguration(StringRef shape, unsigned size, int fd) {
+        LLVMContext CTX;
+        Generator generator(CTX);
+        std::unique_ptr<Module> M = generator.generate(shape, size);
+
+        // The generated module has no annotations, so the level is set directly, as ObfuscationLevels would
+        for (Function &F : *M) {
+            if (!F.isDeclaration()) F.addFnAttr(OBFUSCATION_LEVEL_ATTRIBUTE, std::to_string(std::min<unsigned>(Level, OBFUSCATION_LEVEL_MAX)));
+        }
+
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        // 1. Time every pass of the pipeline as it runs, and skip the ones not asked for
+        PassInstrumentationCallbacks PIC;
+        std::chrono::steady_clock::time_point start;
+        bool failed = false;
+        PIC.registerShouldRunOptionalPassCallback([](StringRef pass, Any) {
+            return PassList.empty() || is_contained(PassList, shortName(pass));
+        });
+        PIC.registerBeforeNonSkippedPassCallback([&](StringRef, Any) { start = std::chrono::steady_clock::now(); });
+        PIC.registerAfterPassCallback([&](StringRef pass, Any, const PreservedAnalyses &) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            PassResult result = {{}, countInstructions(*M), elapsed.count(), usage.ru_maxrss};
+            strncpy(result.pass, shortName(pass).str().c_str(), sizeof(result.pass) - 1);
+            if (!failed && write(fd, &result, sizeof(result)) != sizeof(result)) failed = true;
+        });
+
+        PassBuilder PB(nullptr, PipelineTuningOptions(), std::nullopt, &PIC);
+        FAM.registerPass([] { return ObfuscationInfo(); });
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        // 2. The same passes as the Pipeline plugin above -O0
+        ModulePassManager MPM;
+        addObfuscationPasses(MPM, OptimizationLevel::O2);
+        MPM.addPass(IntegrityCheck());
+        MPM.run(*M, MAM);
+
+        if (verifyModule(*M, &errs())) _exit(BENCH_EXIT_BROKEN);
+    }
+
+    // Returns the results of the passes that completed, and a description of how the child ended.
+    std::vector<PassResult> measure(StringRef shape, unsigned size, std::string &status) {
+        int fds[2];
+        if (pipe(fds) < 0) ExitOnErr(errorCodeToError(std::error_code(errno, std::generic_category())));
+
+        outs().flush();
+        pid_t child = fork();
+        if (child == 0) {
+            close(fds[0]);
+            rlimit limit = {(rlim_t)MemoryLimit << 20, (rlim_t)MemoryLimit << 20};
+            setrlimit(RLIMIT_AS, &limit);
+            alarm(Timeout);
+            // Report hitting -memory-limit as such, not as a crash
+            std::set_new_handler([] { _exit(BENCH_EXIT_MEMORY); });
+            install_bad_alloc_error_handler([](void *, const char *, bool) { _exit(BENCH_EXIT_MEMORY); });
+            int devNull = open("/dev/null", O_WRONLY);                                  // Drop the per-function logs of the passes
+            dup2(devNull, STDERR_FILENO);
+            runConfiguration(shape, size, fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+
+        std::vector<PassResult> results;
+        PassResult result;
+        while (read(fds[0], &result, sizeof(result)) == sizeof(result)) results.push_back(result);
+        close(fds[0]);
+
+        int wstatus;
+        waitpid(child, &wstatus, 0);
+        if (WIFSIGNALED(wstatus)) {
+            int signal = WTERMSIG(wstatus);
+            status = signal == SIGALRM ? "timeout" : formatv("killed by signal {0} ({1})", signal, strsignal(signal)).str();
+        } else if (WEXITSTATUS(wstatus) == BENCH_EXIT_BROKEN) {
+            status = "broken module";
+        } else if (WEXITSTATUS(wstatus) == BENCH_EXIT_MEMORY) {
+            status = "out of memory";
+        } else if (WEXITSTATUS(wstatus) != 0) {
+            status = formatv("exit status {0}", WEXITSTATUS(wstatus)).str();
+        } else {
+            status = "ok";
+        }
+        return results;
+    }
+}
+
+int main(int argc, char **argv) {
+    cl::ParseCommandLineOptions(argc, argv, "Compile-time scaling benchmark for the obfuscation passes\n");
+    srand(time(NULL));
+
+    std::vector<std::string> shapes(ShapeList.begin(), ShapeList.end());
+    std::vector<unsigned> sizes(SizeList.begin(), SizeList.end());
+    if (shapes.empty()) shapes.assign(std::begin(Generator::Shapes), std::end(Generator::Shapes));
+    if (sizes.empty()) sizes = {10, 100, 1000, 10000, 100000};
+    for (const std::string &shape : shapes) {
+        if (!Generator::isShape(shape)) ExitOnErr(createStringError(inconvertibleErrorCode(), "unknown shape " + shape));
+    }
+
+    if (!EmitFilename.empty()) {
+        LLVMContext CTX;
+        Generator generator(CTX);
+        std::unique_ptr<Module> M = generator.generate(shapes[0], sizes[0]);
+
+        std::error_code EC;
+        raw_fd_ostream OS(EmitFilename, EC, sys::fs::OF_None);
+        if (EC) ExitOnErr(errorCodeToError(EC));
+        WriteBitcodeToFile(*M, OS);
+        return 0;
+    }
+
+    outs() << formatv("{0,-10} {1,8} {2,-22} {3,12} {4,12} {5,12}\n", "shape", "size", "pass", "instrs", "time [ms]", "peak [MiB]");
+    unsigned superlinear = 0;
+    for (const std::string &shape : shapes) {
+        std::map<std::string, std::pair<unsigned, double>> previous;                    // Pass -> (size, seconds) at the last size
+        for (unsigned size : sizes) {
+            std::string status;
+            std::vector<PassResult> results = measure(shape, size, status);
+
+            for (const PassResult &result : results) {
+                outs() << formatv("{0,-10} {1,8} {2,-22} {3,12} {4,12:F1} {5,12:F1}", shape, size, result.pass,
+                                  result.instructions, result.seconds * 1000, result.peakRssKb / 1024.0);
+
+                // Growth exponent k of time ~ size^k. Very short runs are mostly noise, so they are not judged.
+                auto last = previous.find(result.pass);
+                if (last != previous.end() && last->second.second > 0.01) {
+                    double exponent = std::log(result.seconds / last->second.second) / std::log((double)size / last->second.first);
+                    if (exponent > BENCH_SUPERLINEAR) {
+                        outs() << formatv("   [!] superlinear (size^{0:F2})", exponent);
+                        superlinear++;
+                    }
+                }
+                outs() << "\n";
+                previous[result.pass] = {size, result.seconds};
+            }
+
+            if (status != "ok") {
+                outs() << formatv("{0,-10} {1,8} stopped after {2} passes: {3}\n", shape, size, results.size(), status);
+                break;                                                                  // Larger sizes will not do better
+            }
+        }
+    }
+
+    outs() << formatv("\n[+] {0} superlinear measurements\n", superlinear);
+    return superlinear ? 1 : 0;
+}
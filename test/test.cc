@@ -1,6 +1,10 @@
+#include <pthread.h>
 #include <stdio.h>
 
-extern "C" int check_number(int n) {
+// From runtime/integrity.c, linked in by `make test`
+extern "C" void __ollvm_integrity_step(void);
+
+extern "C" __attribute__((annotate("obfuscate"))) int check_number(int n) {
     if (n > 0) {
         printf("The number %d is positive.\n", n);
         return 1;
@@ -13,7 +17,7 @@ extern "C" int check_number(int n) {
     }
 }
 
-extern "C" void arithmetic() {
+extern "C" __attribute__((annotate("obfuscate"))) void arithmetic() {
     volatile int a = 10;
     volatile int b = 5;
 
@@ -34,13 +38,71 @@ extern "C" int add(int a, int b) {
     return a + b;
 }
 
-extern "C" void my_function() {
+extern "C" __attribute__((annotate("obfuscate"))) void my_function() {
     // volatile to prevent optimization
     volatile int result = add(2, 1);
 
     printf("2 + 1 = %d\n", result);
 }
 
+// Small enough for InlineHelpers (above -O0) to fold into `apply_scale`. Its address is taken as well,
+// so a copy stays for the indirect call, without the alwaysinline.
+extern "C" int scale(int x) {
+    return x * 4 + 2;
+}
+
+extern "C" __attribute__((annotate("obfuscate"))) int apply_scale(int (*fn)(int), int x) {
+    return scale(x) + fn(x);
+}
+
+// Only reached from `checksum`, through its loop, so it is hot and gets two levels less
+extern "C" unsigned digest_round(unsigned h, unsigned c) {
+    for (int i = 0; i < 4; ++i) {
+        h = (h << 5) + h + c;
+        c ^= h >> 7;
+    }
+    return h ^ c;
+}
+
+extern "C" __attribute__((annotate("obfuscate"))) unsigned checksum(const char *s) {
+    unsigned h = 5381;
+    while (*s) {
+        h = digest_round(h, *s++);
+    }
+    return h;
+}
+
+// Far more than SPLIT_CHUNK_THRESHOLD instructions in one block, so SplitBasicBlocks cuts it into chunks
+extern "C" __attribute__((annotate("obfuscate"))) unsigned mix(unsigned x) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    x += 0x9e3779b9;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    x += 0x7f4a7c15;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return x;
+}
+
+// Encrypted by `make test` and first called from several threads at once: one of them decrypts the
+// body, the others wait for it or already take the patched jump
+extern "C" __attribute__((annotate("obfuscate"))) int triangle(int n) {
+    int sum = 0;
+    for (int i = 1; i <= n; ++i) {
+        sum += i;
+    }
+    return sum;
+}
+
+static void *triangle_thread(void *arg) {
+    int *n = (int *)arg;
+    *n = triangle(*n);
+    return NULL;
+}
+
+// Reached from no annotated function: level 0, left alone
+extern "C" int untouched(int x) {
+    return x * 3 + 1;
+}
+
 int main() {
     my_function();
     
@@ -50,5 +112,28 @@ int main() {
     check_number(-5);
     check_number(0);
 
+    printf("checksum: %u\n", checksum("ollvm")); // Expected: 2211146885
+    printf("untouched: %d\n", untouched(41)); // Expected: 124
+    printf("mix: %u\n", mix(42)); // Expected: 2387372182
+
+    int (*volatile fn)(int) = scale;
+    printf("scale: %d\n", apply_scale(fn, 10)); // Expected: 84
+
+    pthread_t threads[4];
+    int triangles[4] = {10, 20, 30, 40};
+    for (int i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, triangle_thread, &triangles[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("triangle: %d %d %d %d\n", triangles[0], triangles[1], triangles[2], triangles[3]); // Expected: 55 210 465 820
+
+    // Go around every protected function a few times: aborts if a hash does not match the patched binary
+    for (int i = 0; i < 1000; ++i) {
+        __ollvm_integrity_step();
+    }
+    printf("integrity: ok\n");
+
     return 0;
 }